@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Process-wide slab pool for chunk-sized buffers (encode output, stream
+// blocks). Requests of ARENA_MIN_CLASS and up are rounded to a power-of-two
+// class; freed buffers go on that class's free list and serve the next chunk
+// or file, so steady-state compression allocates nothing from the heap.
+// Smaller requests go straight to operator new. Thread-safe.
+constexpr std::size_t ARENA_MIN_CLASS = std::size_t(64) << 10;
+
+void* arena_alloc(std::size_t n);
+void  arena_free(void* p, std::size_t n);   // n as passed to arena_alloc
+
+// Buffers of 2 MiB and more on transparent huge pages (Linux, madvise), which
+// saves TLB misses on large blocks. Off by default; set before starting work.
+void set_huge_pages(bool on);
+
+struct ArenaStats {
+    std::uint64_t fresh = 0;    // class buffers taken from the heap
+    std::uint64_t reused = 0;   // class buffers served from a free list
+    std::size_t pooled = 0;     // bytes sitting on the free lists now
+};
+ArenaStats arena_stats();
+
+// Allocator over the arena. resize() leaves new bytes uninitialised: buffers
+// are written before they are read, so growing one costs no memset.
+template <class T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template <class U> ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(arena_alloc(n * sizeof(T))); }
+    void deallocate(T* p, std::size_t n) noexcept { arena_free(p, n * sizeof(T)); }
+
+    template <class U> void construct(U* p) noexcept { ::new (static_cast<void*>(p)) U; }
+    template <class U, class... A> void construct(U* p, A&&... a) {
+        ::new (static_cast<void*>(p)) U(std::forward<A>(a)...);
+    }
+
+    friend bool operator==(const ArenaAllocator&, const ArenaAllocator&) { return true; }
+};
+
+using ByteBuf = std::vector<std::uint8_t, ArenaAllocator<std::uint8_t>>;
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// `huff bench`: in-memory compress/decompress throughput over synthetic,
+// seeded corpora, so runs are comparable across machines and releases.
+
+struct BenchOptions {
+    std::vector<std::string> corpora;   // empty = all (see bench_corpora)
+    std::vector<int> threads;           // empty = 1, 2, 4, ... up to the core count
+    std::size_t size = std::size_t(16) << 20;   // bytes per corpus
+    int iters = 5;                      // timed runs per case; the fastest counts
+    std::string json;                   // also write results as JSON here ("-" = stdout)
+    std::string kernel;                 // encode kernel to force (see set_encode_kernel)
+};
+
+// Names accepted in BenchOptions::corpora.
+const std::vector<std::string>& bench_corpora();
+
+// Prints a table to stdout. Returns 0, 1 on an unknown corpus or kernel or JSON file
+// error, or the failing call's error code (or 10 on a round-trip mismatch).
+int run_bench(const BenchOptions& opt);
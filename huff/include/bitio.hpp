@@ -1,18 +1,30 @@
 #pragma once
 #include <cstdint>
 #include <cstdio>
+#include <cstddef>
+#include <vector>
 
 // Simple bit-level writer/reader using std::FILE*.
 // Writes MSB-first within a byte.
 
+// Bits collect in a 64-bit accumulator and leave it 32 at a time into a
+// 64 KiB staging buffer that is fwrite'n when full. Call flush() at the end.
 struct BitWriter {
     std::FILE* f = nullptr;
-    uint8_t buf = 0;
-    int bits = 0;
-    explicit BitWriter(std::FILE* fp) : f(fp) {}
-    void write_bit(int b);
-    void write_bits(uint32_t v, int n);
-    void flush();
+    std::uint64_t acc = 0;     // pending bits, right-aligned
+    int bits = 0;              // pending bit count (< 32 between calls)
+    std::vector<std::uint8_t> out;
+    explicit BitWriter(std::FILE* fp) : f(fp) { out.reserve(OUT_CAP); }
+    void write_bit(int b) { write_bits(std::uint32_t(b & 1), 1); }
+    void write_bits(std::uint32_t v, int n);            // low n bits of v, n <= 32
+    void write_bytes(const std::uint8_t* p, std::size_t n); // n whole bytes
+    void flush();              // pad the last byte with zeros and write everything out
+
+    static constexpr std::size_t OUT_CAP = std::size_t(1) << 16;
+private:
+    void put32(std::uint32_t w);
+    void drain_bytes();        // move whole pending bytes to out (bits % 8 stays)
+    void spill();              // fwrite out
 };
 
 struct BitReader {
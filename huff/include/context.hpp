@@ -0,0 +1,60 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "huff.hpp"
+#include "decode.hpp"
+#include "threads.hpp"
+#include "io.hpp"
+
+// Internal: state that HuffContext keeps across calls (file calls use a
+// fresh one). Nothing here is part of the public API.
+
+// Holds one window of raw HUF2 blocks (headers + bodies) and the state carried
+// across windows. run() lives in decompress.cpp.
+struct BlockWindow {
+    const DecodeTable* table = nullptr;
+    int threads = 1;
+    std::size_t window = 2;              // blocks per run(), from plan_stream
+    OutputSink* out = nullptr;
+    std::uint32_t crc = 0;               // CRC32 of the output so far, merged per block
+    std::uint64_t written = 0;
+    std::uint64_t blocks = 0;            // blocks committed so far
+    TestResult bad;                      // where the last failing run() (or HUF1 decode) stopped
+
+    const std::uint8_t* src = nullptr;   // the window: block headers + bodies
+    std::size_t src_len = 0;
+    std::vector<std::uint8_t> src_buf;   // backing store when the input is not mapped
+    std::vector<std::size_t> starts;     // block header offsets in src
+    std::vector<DecodeJob> jobs;
+    std::vector<std::uint32_t> block_crc;
+
+    // Decodes every block in src straight into the sink, checks per-block CRCs and commits.
+    // expect_raw, if given, holds the raw lengths the index recorded for these blocks.
+    // A discarding sink gets stored blocks checksummed in place instead of copied.
+    int run(const std::uint32_t* expect_raw);
+};
+
+// --- shared tables (tables.cpp) ---
+// Decode table of a registered SharedTable, or null if none has that ID.
+const DecodeTable* find_shared_table(std::uint32_t id);
+// Codes every byte with a prefix code and carries the matching ID.
+bool shared_table_usable(const SharedTable& t);
+
+struct HuffContext::Scratch {
+    // --- compress: per-chunk state of the input being planned ---
+    std::vector<std::uint32_t> chunk_crcs;
+    std::vector<std::array<std::uint64_t,256>> chunk_freqs;
+    std::vector<std::uint8_t> stored;    // nonzero: chunk goes out as BLOCK_STORED
+    std::vector<MemBitWriter> chunks;    // encoded chunks (buffer calls)
+
+    // --- HUF2 index, being written or read ---
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::uint32_t> raw_lens;
+
+    // --- decompress ---
+    DecodeTable table;
+    BlockWindow win;
+    std::vector<std::uint8_t> range_buf;   // whole blocks around a requested range
+};
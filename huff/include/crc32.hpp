@@ -2,5 +2,13 @@
 #include <cstdint>
 #include <cstddef>   
 
+// crc32_update runs on raw (pre-/post-inverted) state; crc32 and crc32_combine
+// work on finished CRCs. The kernel (PCLMULQDQ folding or slicing-by-16) is
+// picked once at runtime from CPUID.
 std::uint32_t crc32_update(std::uint32_t crc, const unsigned char* data, std::size_t len);
 inline std::uint32_t crc32(const unsigned char* data, std::size_t len) { return crc32_update(0xFFFFFFFFu, data, len) ^ 0xFFFFFFFFu; }
+
+// CRC of A||B from crc(A), crc(B) and len(B), so chunks can be checksummed in parallel.
+std::uint32_t crc32_combine(std::uint32_t crc1, std::uint32_t crc2, std::uint64_t len2);
+
+const char* crc32_kernel_name();
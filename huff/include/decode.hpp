@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Table-driven canonical Huffman decoder.
+// The primary table is indexed by the next DEC_TABLE_BITS bits of the stream
+// (MSB-first, same bit order as BitWriter) and resolves one or two symbols per
+// probe. Codes longer than DEC_TABLE_BITS fall back to a canonical search
+// over per-length first codes.
+
+constexpr int DEC_TABLE_BITS = 11;
+constexpr int DEC_MAX_LEN    = 32;   // Codeword holds 32-bit codes
+
+struct DecodeTable {
+    // fast entry: bits 0..7 sym0, 8..15 sym1, 16..17 symbol count (0 = long/invalid),
+    //             24..31 total bits consumed
+    std::array<std::uint32_t, 1u << DEC_TABLE_BITS> fast{};
+
+    // slow path, indexed by code length
+    int max_len = 0;
+    std::uint32_t first[DEC_MAX_LEN + 1] = {};  // first canonical code of each length
+    std::uint32_t count[DEC_MAX_LEN + 1] = {};  // number of codes of each length
+    std::uint16_t offset[DEC_MAX_LEN + 1] = {}; // index into syms[] of the first code
+    std::uint8_t  syms[256] = {};               // symbols sorted by (len, sym)
+    int nsyms = 0;
+};
+
+// Builds the tables from the 256 code lengths stored in the header.
+// Returns false if the lengths do not form a valid prefix code.
+bool build_decode_table(const std::array<std::uint8_t,256>& lens, DecodeTable& t);
+
+// Decodes up to n symbols from src[0..src_len) starting at bit_pos (advanced on return).
+// When more input may follow (final == false) decoding stops early, without error,
+// once fewer than DEC_LOOKAHEAD bytes remain so the caller can slide in more data.
+// Returns the number of symbols written; err is set to 6 (truncated) or 7 (bad code).
+constexpr std::size_t DEC_LOOKAHEAD = 32;
+
+std::size_t decode_symbols(const DecodeTable& t,
+                           const std::uint8_t* src, std::size_t src_len, bool final,
+                           std::uint64_t& bit_pos,
+                           std::uint8_t* dst, std::size_t n, int& err);
+
+// Decodes a multi-stream payload (jump table + sub-streams, see format.hpp)
+// into dst[0..dst_len), advancing all sub-streams in lockstep so their
+// table lookups overlap. Returns 0, 6 (truncated), 7 (bad code) or 11 (bad jump table).
+int decode_multi(const DecodeTable& t,
+                 const std::uint8_t* src, std::size_t src_len,
+                 std::uint8_t* dst, std::size_t dst_len);
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// HUF2 indexed block container.
+//
+//   header  "HUF2" | block_size u32 | lengths[256]
+//   blocks  type u8 | raw_len u32 | comp_len u32 | crc32 u32 | body[comp_len]
+//   end     type = BLOCK_END, all other header fields 0
+//   index   per block: offset of its block header u64 | raw_len u32
+//   footer  orig_size u64 | crc32 u32 | nblocks u32 | index_offset u64 | "HUF2"
+//
+// Every block but the last holds exactly block_size raw bytes, so block i
+// covers output [i * block_size, ...) and nblocks == ceil(orig_size / block_size).
+// Integers are little-endian. Every payload is its own MSB-first bitstream,
+// zero-padded to a byte, so blocks decode independently and in any order.
+// Seekable readers go through the index; pipe readers walk the blocks up to
+// the END marker. Streamed files leave the header lengths all zero and give
+// every block its own table. Blocks that coding would not shrink are stored raw.
+//
+// Multi-stream blocks split the raw block into n equal segments (the last one
+// shorter, see stream_segment) and code each as its own byte-aligned stream so
+// a decoder can advance all of them in one loop:
+//   jump table  n u8 | byte length of streams 0..n-2, u32 each (the last takes the rest)
+//
+// Files coded with a shared table (`huff train`) swap the header for
+//   header  "HUFD" | block_size u32 | table_id u32
+// and are HUF2 from there on, footer magic included. Their BLOCK_HUFF* blocks
+// use the registered table with that ID instead of header lengths.
+//   table file  "HUFT" | table_id u32 | lengths[256]    (table_id = CRC32 of lengths)
+// HUF1 (single bitstream, see README) stays readable.
+
+constexpr std::uint8_t HUF1_MAGIC[4] = {'H','U','F','1'};
+constexpr std::uint8_t HUF2_MAGIC[4] = {'H','U','F','2'};
+constexpr std::uint8_t HUFD_MAGIC[4] = {'H','U','F','D'};
+constexpr std::uint8_t HUFT_MAGIC[4] = {'H','U','F','T'};
+
+constexpr std::size_t HUF1_HEADER_SIZE       = 4 + 8 + 256 + 1 + 4;
+constexpr std::size_t HUF2_HEADER_SIZE       = 4 + 4 + 256;
+constexpr std::size_t HUF2_BLOCK_HEADER_SIZE = 1 + 4 + 4 + 4;
+constexpr std::size_t HUF2_INDEX_ENTRY_SIZE  = 8 + 4;
+constexpr std::size_t HUF2_FOOTER_SIZE       = 8 + 4 + 4 + 8 + 4;
+constexpr std::size_t HUFD_HEADER_SIZE       = 4 + 4 + 4;
+constexpr std::size_t HUFT_FILE_SIZE         = 4 + 4 + 256;
+
+enum BlockType : std::uint8_t {
+    BLOCK_HUFF       = 0,    // body = payload coded with the file's code table
+    BLOCK_HUFF_TABLE = 1,    // body = lengths[256] + payload coded with that table
+    BLOCK_STORED     = 2,    // body = the raw bytes (comp_len == raw_len), for incompressible data
+    BLOCK_HUFF_MULTI       = 3,  // body = jump table + sub-streams coded with the file's table
+    BLOCK_HUFF_TABLE_MULTI = 4,  // body = lengths[256] + jump table + sub-streams
+    BLOCK_END        = 0xFF, // terminates the block list
+};
+
+constexpr std::size_t HUF2_BLOCK_SIZE = std::size_t(1) << 20;   // largest block the compressor writes (sched.hpp picks per input)
+constexpr int HUF2_MAX_STREAMS = 8;
+
+inline std::size_t stream_jump_table_size(int n) { return 1 + 4 * std::size_t(n - 1); }
+// raw bytes per segment of a multi-stream block
+inline std::size_t stream_segment(std::size_t raw_len, int n) { return (raw_len + std::size_t(n) - 1) / std::size_t(n); }
+
+inline std::uint32_t load_u32_le(const std::uint8_t* p) {
+    return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) |
+           (std::uint32_t(p[2]) << 16) | (std::uint32_t(p[3]) << 24);
+}
+inline std::uint64_t load_u64_le(const std::uint8_t* p) {
+    return std::uint64_t(load_u32_le(p)) | (std::uint64_t(load_u32_le(p + 4)) << 32);
+}
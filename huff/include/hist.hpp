@@ -0,0 +1,26 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Byte histogram fused with CRC32: the input is counted through four
+// interleaved sub-tables (so long runs of one byte don't stall on a single
+// counter) and checksummed 64 KiB at a time while it is still in cache.
+
+// Adds the byte counts of p[0..len) to freq; returns crc32 of the range.
+std::uint32_t count_bytes(const std::uint8_t* p, std::size_t len,
+                          std::array<std::uint64_t,256>& freq);
+
+// Same over chunk_size slices on up to `threads` workers: freq receives the
+// total, chunk_crcs[i] the CRC32 of slice i and, if given, chunk_freqs[i] its
+// own counts.
+void histogram_parallel(std::span<const std::uint8_t> data, std::size_t chunk_size, int threads,
+                        std::array<std::uint64_t,256>& freq,
+                        std::vector<std::uint32_t>& chunk_crcs,
+                        std::vector<std::array<std::uint64_t,256>>* chunk_freqs = nullptr);
+
+// Payload size in bits of a histogram coded with lens (exact, no entropy bound).
+std::uint64_t coded_bits(const std::array<std::uint64_t,256>& freq,
+                         const std::array<std::uint8_t,256>& lens);
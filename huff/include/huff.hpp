@@ -1,4 +1,127 @@
 #pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
 
-int compress_file(const char* in_path, const char* out_path, int level);
-int decompress_file(const char* in_path, const char* out_path, int verify);
+constexpr int HUFF_MAX_CODE_LEN = 15;   // default code length bound
+constexpr int HUFF_MIN_CODE_LEN = 8;    // shortest bound that still fits 256 symbols
+
+struct SharedTable;   // trained code table, see below
+
+struct CompressOptions {
+    int level  = 5;
+    int format = 2;        // 2 = indexed HUF2 (parallel decode), 1 = legacy HUF1
+    bool stream = false;   // bounded-memory block-by-block mode; implied when reading stdin
+    int max_code_len = HUFF_MAX_CODE_LEN;   // longest code written, HUFF_MIN_CODE_LEN..32
+    int streams = 4;       // HUF2 sub-streams per block (1..HUF2_MAX_STREAMS); 1 = single stream
+    int threads = 0;       // 0 = one per core; 1 = everything on the calling thread
+    const SharedTable* table = nullptr;   // code with this trained table (HUF2 only, see below)
+};
+
+// A path of "-" means stdin / stdout. decompress_file always checks the CRCs;
+// verify is accepted for compatibility (test_file checks without any output).
+int compress_file(const char* in_path, const char* out_path, const CompressOptions& opt);
+int decompress_file(const char* in_path, const char* out_path, int verify, int threads = 0);
+
+// --- in-memory API ---
+// Same container and error codes as the file calls, plus HUFF_ERR_DST_TOO_SMALL.
+// compress_buffer always writes HUF2 (format 1 or stream returns 4).
+constexpr int HUFF_ERR_DST_TOO_SMALL = 12;
+
+// Scratch buffers and tables kept across buffer calls, so repeated calls of
+// similar size don't allocate. Work runs on the process-wide thread pool
+// (threads.hpp), at most `threads` tasks at a time. One context per caller thread.
+struct HuffContext {
+    explicit HuffContext(int threads = 0);   // 0 = one per core
+    ~HuffContext();
+    HuffContext(const HuffContext&) = delete;
+    HuffContext& operator=(const HuffContext&) = delete;
+
+    struct Scratch;   // context.hpp
+    int threads;
+    std::unique_ptr<Scratch> scratch;
+};
+
+// Largest compress_buffer output for src_len input bytes.
+std::size_t compress_bound(std::size_t src_len);
+
+// Original size recorded in a HUF1/HUF2 buffer; false if src is not one.
+bool decompressed_size(const void* src, std::size_t src_len, std::uint64_t& size);
+
+int compress_buffer(HuffContext& ctx, const void* src, std::size_t src_len,
+                    void* dst, std::size_t dst_cap, std::size_t& out_len,
+                    const CompressOptions& opt = CompressOptions{});
+int decompress_buffer(HuffContext& ctx, const void* src, std::size_t src_len,
+                      void* dst, std::size_t dst_cap, std::size_t& out_len);
+
+// --- random access (HUF2) ---
+// Decode only the blocks overlapping [offset, offset + length) of the original
+// data and write just that range (clamped to the end of the data). Block i
+// starts at i * block_size, so a lookup costs the footer, one slice of the
+// index and the blocks themselves. HUF1 and unseekable input (pipes) have no
+// usable index and return HUFF_ERR_NO_INDEX.
+constexpr int HUFF_ERR_NO_INDEX = 13;
+
+int decompress_range(const char* in_path, const char* out_path,
+                     std::uint64_t offset, std::uint64_t length, int threads = 0);
+int decompress_range_buffer(HuffContext& ctx, const void* src, std::size_t src_len,
+                            std::uint64_t offset, std::uint64_t length,
+                            void* dst, std::size_t dst_cap, std::size_t& out_len);
+
+// --- integrity test ---
+// Decodes in_path and checks every block CRC and the file CRC like
+// decompress_file, but the output goes nowhere: blocks are decoded a window at
+// a time into one reused buffer and stored blocks are checksummed in place, so
+// a test costs the read and the decode, with no write I/O. HUF2 decodes on
+// `threads` cores (0 = all), HUF1 on one.
+struct TestResult {
+    std::uint64_t size = 0;         // bytes the input decodes to (on success)
+    // On failure, the first region of the original data that did not check out:
+    // the failing block (-1 when the damage is not tied to one block), and its
+    // bytes. bad_length is 0 when the container itself (header, index or
+    // footer) is damaged and no data could be placed.
+    std::int64_t  bad_block = -1;
+    std::uint64_t bad_offset = 0;
+    std::uint64_t bad_length = 0;
+};
+
+// Same error codes as decompress_file.
+int test_file(const char* in_path, TestResult& result, int threads = 0);
+
+// --- shared code tables ---
+// A table trained on samples of similar data (`huff train`) lets inputs skip
+// the histogram and table build, and keeps the 256 code lengths out of every
+// file: the header names the table by ID instead. Blocks that the table would
+// not shrink are still stored raw. Decoding such a file needs the same table
+// registered first, otherwise it fails with HUFF_ERR_NO_TABLE.
+constexpr int HUFF_ERR_NO_TABLE = 14;
+
+struct SharedTable {
+    std::uint32_t id = 0;                       // CRC32 of lengths
+    std::array<std::uint8_t,256> lengths{};     // every byte value has a code
+};
+
+// Code lengths for the byte counts of the samples; bytes never seen still get
+// a (long) code, so the table can code any input.
+SharedTable train_table(const std::array<std::uint64_t,256>& freq, int max_len = HUFF_MAX_CODE_LEN);
+
+// Table files: 0, 1 cannot open, 2 not a table (bad magic, ID or lengths),
+// 3 write error.
+int save_table(const char* path, const SharedTable& t);
+int load_table(const char* path, SharedTable& t);
+
+// Makes t known to decoders for the rest of the process (thread-safe); its
+// decode table is built once, here. False if t is not a valid table (some byte
+// without a code, not a prefix code, or an ID that does not match).
+bool register_table(const SharedTable& t);
+
+// --- canonical code construction ---
+
+// Optimal code lengths for freq with no code longer than max_len (package-merge
+// on stack arrays, no heap). Unused symbols get 0, a lone symbol gets 1.
+std::array<std::uint8_t,256> code_lengths(const std::array<std::uint64_t,256>& freq,
+                                          int max_len = HUFF_MAX_CODE_LEN);
+
+// Canonical codes (ordered by length, then symbol), right-aligned in codes[s].
+void canonical_codes(const std::array<std::uint8_t,256>& lens, std::array<std::uint32_t,256>& codes);
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// File helpers shared by compress/decompress. A path of "-" means stdin/stdout
+// (switched to binary mode on Windows).
+
+std::FILE* open_input(const char* path);
+std::FILE* open_output(const char* path);
+int close_file(std::FILE* f);      // fclose, or just fflush for stdin/stdout
+
+bool is_std_path(const char* path);
+bool is_seekable(std::FILE* f);    // regular file we can fseek around in
+
+// 64-bit fseek/ftell
+bool seek_to(std::FILE* f, std::int64_t off, int whence);
+std::int64_t tell_pos(std::FILE* f);
+
+// --- I/O backend ---
+// "stdio" (default): mapped input, pwrite / stdio output. "uring" (Linux):
+// whole inputs are read through an io_uring with several reads in flight, and
+// positional output queues its block writes on one, so neither side waits
+// for one request at a time. Selecting "uring" fails where io_uring is not
+// available (old kernel, seccomp, other OS); the stdio path is then kept.
+// Limitation: the input read is not pipelined. load() returns once the last
+// read has landed, so coding starts only after the whole read, and the heap
+// copy stays resident (release() cannot drop it the way it drops mapped
+// pages). Stream mode and pipes read through stdio on either backend.
+bool set_io_backend(const char* name);   // false if unknown or unavailable here
+const char* io_backend_name();
+// O_DIRECT for uring input reads, into page-aligned buffers: bypasses the page
+// cache for inputs read once. Ignored by stdio and where the filesystem refuses it.
+void set_direct_io(bool on);
+
+// Read-only mapping of a whole regular file. open() fails for pipes, "-" and
+// anything the OS refuses to map, so callers fall back to stdio.
+struct MappedInput {
+    const std::uint8_t* data = nullptr;
+    std::size_t size = 0;
+
+    MappedInput() = default;
+    MappedInput(const MappedInput&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+    ~MappedInput() { close(); }
+
+    bool open(const char* path);
+    // open(), or with the uring backend the whole file read into memory
+    // through io_uring before it returns (falling back to open() if that
+    // fails). Under a memory limit (sched.hpp) files over a quarter of it are
+    // always mapped.
+    bool load(const char* path);
+    // Done with [off, off + n) for now: its whole pages leave the resident set
+    // (they fault back in from the file if touched again). Mappings only.
+    void release(std::size_t off, std::size_t n) const;
+    void view(const std::uint8_t* p, std::size_t n);   // wrap caller memory (nothing to unmap)
+    void close();
+    bool is_open() const { return opened; }
+
+    bool opened = false;
+    void* map = nullptr;
+    void* heap = nullptr;   // load(): aligned buffer the file was read into
+};
+
+// Destination for decoded bytes. With a known size and a regular file path the
+// output is preallocated and mapped, and reserve() hands out pointers straight
+// into the mapping; otherwise bytes are staged in a buffer and fwrite'n.
+struct OutputSink {
+    // size == UNKNOWN_SIZE forces the buffered path
+    static constexpr std::uint64_t UNKNOWN_SIZE = ~std::uint64_t(0);
+
+    bool open(const char* path, std::uint64_t size);
+    void open_buffer(std::uint8_t* p, std::size_t cap);   // decode into caller memory
+    void open_discard();   // decode into one reused buffer and drop it (test_file)
+    std::uint8_t* reserve(std::size_t n);  // room for the next n bytes
+    bool commit(std::size_t n);            // the first n reserved bytes are final
+    int close();                           // 0 on success
+
+    std::FILE* f = nullptr;
+    std::uint8_t* map = nullptr;
+    std::uint64_t size = 0, pos = 0;
+    std::vector<std::uint8_t> buf;
+    int fd = -1;
+    bool borrowed = false;   // map is caller memory: size is its capacity, close() leaves it alone
+    bool discard = false;    // commit() only counts: reserve() hands out buf again
+    std::uint64_t dropped = 0;   // mapped output before this has left the resident set
+};
+
+// One contiguous piece of a positional write.
+struct IoPiece {
+    const void* p = nullptr;
+    std::size_t n = 0;
+};
+
+// Regular output file written at explicit offsets (pwrite), so blocks whose
+// place is already known can go out from several threads at once instead of
+// queueing behind one FILE position. open() fails for "-", non-regular files
+// and on Windows; callers fall back to stdio.
+struct PositionalOutput {
+    PositionalOutput();
+    PositionalOutput(const PositionalOutput&) = delete;
+    PositionalOutput& operator=(const PositionalOutput&) = delete;
+    ~PositionalOutput();   // never closed: abandoned output ends up empty
+
+    // Preallocates size_hint bytes (0 = none); close() trims to the real size.
+    bool open(const char* path, std::uint64_t size_hint);
+    // Writes the pieces back to back from off. Safe from several threads at once;
+    // a failure is remembered and reported by close().
+    bool write_at(std::uint64_t off, const IoPiece* pieces, int n);
+    int close(std::uint64_t final_size);   // 0 on success, after every queued write
+
+    // uring backend: write_queued() hands the write to the kernel and returns;
+    // *done (set by the caller) turns false once it has landed. The pieces'
+    // memory must stay put until then. wait() reaps completions until it has.
+    bool queued() const { return ring != nullptr; }
+    void write_queued(std::uint64_t off, const IoPiece* pieces, int n, std::atomic<bool>* done);
+    void wait(const std::atomic<bool>& done);
+
+    int fd = -1;
+    std::atomic<bool> failed{false};
+    struct Ring;   // io.cpp
+    std::unique_ptr<Ring> ring;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Scheduling policy: thread count and block size for an input, from its size
+// and the machine's caches and NUMA layout. Linux reads them from sysfs and the
+// process affinity mask; elsewhere there is one node and default cache sizes.
+
+struct CpuTopology {
+    int cpus = 1;                          // CPUs this process may run on
+    std::size_t l2_bytes = std::size_t(1) << 20;   // per-core L2 (unified or data)
+    std::size_t llc_bytes = 0;             // last-level cache, 0 if not reported
+    std::vector<std::vector<int>> nodes;   // usable CPUs of each NUMA node with any
+};
+
+const CpuTopology& cpu_topology();   // read once, on first use
+
+// Blocks never go below this; a thread gets at least SCHED_BYTES_PER_THREAD
+// of input, since a pool round trip costs more than coding less than that.
+constexpr std::size_t SCHED_MIN_BLOCK        = std::size_t(64) << 10;
+constexpr std::size_t SCHED_BYTES_PER_THREAD = std::size_t(128) << 10;
+
+struct WorkPlan {
+    int threads = 1;
+    std::size_t block_size = 0;   // raw bytes per HUF2 block / chunk
+    std::size_t slots = 1;        // blocks in flight: two per thread, one when single-threaded
+};
+
+// threads: caller's cap, 0 = every usable CPU. Blocks are as large as half the
+// L2 allows (at most HUF2_BLOCK_SIZE), then halved until every thread has
+// about four of them to balance over. Under a memory limit, see below.
+WorkPlan plan_work(std::uint64_t input_size, int threads);
+
+// Block-at-a-time work (streaming compress, decode windows) with blocks of
+// block_size, each holding `copies` block-sized buffers while in flight.
+// Decoders pass min_block = block_size: the file fixed it, and they reject a
+// block_size of 0 first (a 0 here plans one slot on one thread).
+WorkPlan plan_stream(std::size_t block_size, int threads, int copies,
+                     std::size_t min_block = SCHED_MIN_BLOCK);
+
+// --- memory budget ---
+// 0 (default) = none. Otherwise plans keep the bytes in flight under the limit:
+// fewer slots first, then smaller blocks (down to SCHED_MIN_BLOCK), and never
+// more threads than slots, so a tight budget costs parallelism rather than
+// failing. Whole-input work also drops mapped pages once they are done with
+// (MappedInput::release, OutputSink). Not thread-safe: set before starting work.
+void set_memory_limit(std::size_t bytes);
+std::size_t memory_limit();
+// Peak resident set size of the process so far, in bytes; 0 where unknown.
+std::size_t peak_memory();
+
+// Whole-input compress bookkeeping per chunk: histogram, CRC, index entry.
+constexpr std::size_t SCHED_CHUNK_META = 256 * 8 + 64;
+// Block-sized buffers a whole-input chunk holds in flight: its mapped input
+// pages and the coded output, which may briefly exceed the input.
+constexpr int SCHED_CHUNK_COPIES = 3;
+
+// Pool worker `worker` runs on the CPUs of NUMA node worker % nodes; a no-op on
+// single-node hosts, where the scheduler already keeps memory local.
+// Returns the node it was placed on.
+int pin_worker(int worker);
+int worker_node(int worker);   // the node pin_worker picks, without pinning
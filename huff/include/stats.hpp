@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+// Opt-in instrumentation behind --stats and --trace. Nothing is recorded
+// until stats_enable(); until then a StageTimer is one predictable branch,
+// and timers sit around whole chunks and blocks, never per symbol.
+
+enum Stage : int {
+    STAGE_READ,     // fread / mapping the input
+    STAGE_HIST,     // histogram, with the input CRC fused in
+    STAGE_TABLE,    // code lengths + canonical codes
+    STAGE_ENCODE,   // chunk -> bitstream
+    STAGE_STITCH,   // HUF1: replay_into the single stream
+    STAGE_WRITE,    // block headers + payload out
+    STAGE_DECODE,   // bitstream -> bytes
+    STAGE_CRC,      // decode-side CRC of the output
+    STAGE_COUNT
+};
+
+extern bool g_stats_on;   // set by stats_enable before any work starts
+extern bool g_trace_on;
+
+void stats_enable(bool trace);
+std::uint64_t stats_now_ns();   // since stats_enable
+
+void stats_record(Stage s, std::uint64_t t0, std::uint64_t t1, std::uint64_t bytes);
+void stats_queue_wait(std::uint64_t ns);                     // submit -> start of one pool task
+void stats_worker_time(int worker, std::uint64_t busy_ns, std::uint64_t idle_ns);
+void stats_name_thread(const char* name);                    // label for the trace
+
+// Times one stage on the calling thread, from construction to destruction.
+struct StageTimer {
+    Stage stage;
+    std::uint64_t bytes;
+    std::uint64_t t0 = 0;
+
+    StageTimer(Stage s, std::uint64_t n) : stage(s), bytes(n) { if (g_stats_on) t0 = stats_now_ns(); }
+    ~StageTimer() { if (g_stats_on) stats_record(stage, t0, stats_now_ns(), bytes); }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+// Per-stage totals, pool busy/idle, queue wait and buffer arena use.
+void stats_print(std::FILE* f);
+// Chrome / Perfetto trace-event JSON, one row per thread. False on I/O error.
+bool stats_write_trace(const char* path);
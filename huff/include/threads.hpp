@@ -2,63 +2,238 @@
 #include <array>
 #include <cstdint>
 #include <vector>
+#include <span>
 #include <cstddef>
+#include <functional>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "arena.hpp"
+#include "decode.hpp"
 
 struct Codeword {
     std::uint32_t code = 0;
     std::uint8_t  len  = 0;
 };
 
+// In-memory bit writer for one chunk. Codes go into a 64-bit accumulator and
+// leave it as whole 32-bit words, so a code costs a shift and an OR. The bytes
+// live in the arena (arena.hpp); the encoders size them for the worst case up
+// front, so a chunk never reallocates while it is coded.
 struct MemBitWriter {
-    std::vector<std::uint8_t> bytes;
-    std::uint8_t buf = 0;
-    int bits = 0;                 // bits currently in buf (0..7)
+    ByteBuf bytes;
+    std::uint64_t acc = 0;        // pending bits, right-aligned
+    int bits = 0;                 // bits currently in acc (0..31 between calls)
     int last_valid_bits = 0;      // valid bits in the final stored byte (0 if none, 8 if full)
 
-    void write_bit(int b) {
-        buf = (std::uint8_t)((buf << 1) | (b & 1));
-        bits++;
-        if (bits == 8) {
-            bytes.push_back(buf);
-            buf = 0; bits = 0;
-        }
-    }
+    // empty again, keeping the byte buffer's capacity
+    void reset() { bytes.clear(); acc = 0; bits = 0; last_valid_bits = 0; }
+
+    void write_bit(int b) { write_bits(std::uint32_t(b & 1), 1); }
     void write_bits(std::uint32_t v, int n) {
-        for (int i = n - 1; i >= 0; --i) write_bit((v >> i) & 1);
+        // callers pass codes whose bits above n are already zero
+        acc = (acc << n) | v;
+        bits += n;
+        if (bits >= 32) {
+            bits -= 32;
+            std::uint32_t w = std::uint32_t(acc >> bits);
+            std::size_t at = bytes.size();
+            bytes.resize(at + 4);
+            bytes[at]     = std::uint8_t(w >> 24);
+            bytes[at + 1] = std::uint8_t(w >> 16);
+            bytes[at + 2] = std::uint8_t(w >> 8);
+            bytes[at + 3] = std::uint8_t(w);
+        }
     }
     void write_code(const Codeword& cw) {
         if (cw.len) write_bits(cw.code, cw.len);
     }
     void flush() {
+        while (bits >= 8) {
+            bits -= 8;
+            bytes.push_back(std::uint8_t(acc >> bits));
+        }
         if (bits > 0) {
             // push partial byte left-justified and remember how many bits are valid
-            std::uint8_t out = (std::uint8_t)(buf << (8 - bits));
-            bytes.push_back(out);
+            bytes.push_back(std::uint8_t(acc << (8 - bits)));
             last_valid_bits = bits;
-            buf = 0; bits = 0;
         } else if (!bytes.empty()) {
             last_valid_bits = 8; // last byte is full
         } else {
             last_valid_bits = 0; // no bytes written
         }
+        acc = 0; bits = 0;
+    }
+
+    // valid bits after flush()
+    std::uint64_t bit_count() const {
+        return bytes.empty() ? 0 : std::uint64_t(bytes.size() - 1) * 8 + std::uint64_t(last_valid_bits);
     }
 
-    // Replay into a sink that has write_bit(int)
+    // Replay into a sink that has write_bytes(p, n) and write_bits(v, n): all
+    // full bytes go over in one call (copied or word-shifted by the sink),
+    // then the valid bits of the last byte.
     template <class BitSink>
     void replay_into(BitSink& sink) const {
         if (bytes.empty()) return;
         const std::size_t N = bytes.size();
-        for (std::size_t i = 0; i < N; ++i) {
-            std::uint8_t b = bytes[i];
-            int emit = (i + 1 == N ? (last_valid_bits ? last_valid_bits : 8) : 8);
-            // bytes are left-justified: emit the MSB-most 'emit' bits
-            for (int k = 7; k >= 8 - emit; --k) sink.write_bit((b >> k) & 1);
-        }
+        const int tail = last_valid_bits ? last_valid_bits : 8;
+        if (tail == 8) { sink.write_bytes(bytes.data(), N); return; }
+        sink.write_bytes(bytes.data(), N - 1);
+        // bytes are left-justified: emit the MSB-most 'tail' bits
+        sink.write_bits(std::uint32_t(bytes[N - 1] >> (8 - tail)), tail);
     }
 };
 
-void encode_chunks_parallel(const std::vector<std::uint8_t>& data,
+// Encodes len bytes of p into mbw (appends, then flushes the final partial byte).
+// Reserves the worst case, len x longest code, before the first byte.
+// Runs on the kernel picked at startup from CPUID (encode.cpp); every kernel
+// writes the same bytes.
+void encode_chunk(const std::uint8_t* p, std::size_t len,
+                  const std::array<Codeword,256>& table,
+                  MemBitWriter& mbw);
+
+// Encodes len bytes of p as `streams` (2..HUF2_MAX_STREAMS) byte-aligned
+// sub-streams behind their jump table: the body of a multi-stream block.
+// mbw.bytes holds the result; bit_count() does not apply.
+void encode_chunk_streams(const std::uint8_t* p, std::size_t len,
+                          const std::array<Codeword,256>& table,
+                          int streams, MemBitWriter& mbw);
+
+// Encode kernels, best supported first: "bmi2" and "scalar64" merge several
+// codes per 64-bit accumulator step and store whole words (codes up to 24
+// bits), "reference" calls write_bits per code pair.
+const char* encode_kernel_name();
+bool set_encode_kernel(const char* name);   // false if unknown or unsupported here
+
+// streams > 1 encodes every chunk with encode_chunk_streams. Writers already
+// in out are reset and reused, buffers included.
+void encode_chunks_parallel(std::span<const std::uint8_t> data,
                             const std::array<Codeword,256>& table,
                             std::size_t chunk_size,
                             int threads,
-                            std::vector<MemBitWriter>& out);
+                            std::vector<MemBitWriter>& out,
+                            const std::vector<std::uint8_t>* skip = nullptr,   // nonzero: leave chunk empty
+                            int streams = 1);
+
+// One independently decodable block: src holds its payload, dst receives dst_len bytes.
+struct DecodeJob {
+    const std::uint8_t* src = nullptr;
+    std::size_t src_len = 0;
+    std::uint8_t* dst = nullptr;
+    std::size_t dst_len = 0;
+    const std::uint8_t* lengths = nullptr;  // per-block code lengths[256], or null for the shared table
+    bool stored = false;     // src is the raw bytes: copy, don't decode (dst == src: only checksum)
+    bool multi = false;      // src is a jump table + sub-streams (decode_multi)
+    std::uint32_t crc = 0;   // CRC32 of the decoded bytes
+    int err = 0;             // decode error code (0 = ok, 5 = bad per-block table, 11 = bad jump table)
+};
+
+void decode_blocks_parallel(const DecodeTable& table,
+                            std::vector<DecodeJob>& jobs,
+                            int threads);
+
+// Process-wide worker pool, started on first use. Every worker owns a deque:
+// it pushes and pops its own tasks at the back, idle workers steal from the
+// front of the others (same NUMA node first), and workers with nothing to do
+// sleep on a condvar. Workers are spread over the nodes (pin_worker).
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    static ThreadPool& instance();
+    ~ThreadPool();
+
+    int workers() const { return (int)queues_.size(); }
+
+    // Queues t: on the calling worker's own deque, else round-robin.
+    void submit(Task t);
+    // Runs one queued task on the calling thread; false if there was none.
+    bool run_one();
+
+private:
+    explicit ThreadPool(int n);
+    struct Queue {
+        std::mutex mu;
+        std::deque<Task> tasks;
+    };
+    bool pop(int self, Task& t);   // own back first, then steal others' fronts
+    void worker_loop(int self);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex idle_mu_;
+    std::condition_variable idle_cv_;
+    std::size_t pending_ = 0;      // queued, not yet taken (guarded by idle_mu_)
+    std::size_t rr_ = 0;           // round-robin target for outside submitters
+    bool stop_ = false;
+};
+
+// Runs fn(0..n-1) on the pool with at most `threads` calls in flight (the
+// calling thread is one of them); returns when all calls are done.
+void parallel_for(std::size_t n, int threads, const std::function<void(std::size_t)>& fn);
+
+// Ordered block pipeline over a ring of slots. A reader thread calls fill(slot)
+// on free slots in order (false = no more input), the pool runs code(slot) on
+// each filled slot, and the calling thread runs write(slot) strictly in order
+// as soon as a slot and all before it are coded, then hands it back to the
+// reader. At most ring.size() blocks are in flight. A one-slot ring runs all
+// three in turn on the calling thread: no reader thread, nothing on the pool.
+template <class Slot, class Fill, class Code, class Write>
+void run_pipeline(std::vector<Slot>& ring, Fill fill, Code code, Write write) {
+    if (ring.size() == 1) {
+        while (fill(ring[0])) { code(ring[0]); write(ring[0]); }
+        return;
+    }
+    enum State : std::uint8_t { FREE, CODING, DONE };
+    const std::size_t R = ring.size();
+    std::vector<State> state(R, FREE);
+    std::mutex mu;
+    std::condition_variable cv;
+    std::size_t produced = 0;
+    bool eof = false;
+
+    std::thread reader([&] {
+        for (std::size_t seq = 0;; ++seq) {
+            const std::size_t k = seq % R;
+            {
+                std::unique_lock<std::mutex> lk(mu);
+                cv.wait(lk, [&] { return state[k] == FREE; });
+            }
+            if (!fill(ring[k])) {
+                std::lock_guard<std::mutex> lk(mu);
+                produced = seq;
+                eof = true;
+                cv.notify_all();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lk(mu);
+                state[k] = CODING;
+            }
+            ThreadPool::instance().submit([&, k] {
+                code(ring[k]);
+                std::lock_guard<std::mutex> lk(mu);
+                state[k] = DONE;
+                cv.notify_all();
+            });
+        }
+    });
+
+    for (std::size_t seq = 0;; ++seq) {
+        const std::size_t k = seq % R;
+        {
+            std::unique_lock<std::mutex> lk(mu);
+            cv.wait(lk, [&] { return state[k] == DONE || (eof && produced == seq); });
+            if (state[k] != DONE) break;
+        }
+        write(ring[k]);
+        std::lock_guard<std::mutex> lk(mu);
+        state[k] = FREE;
+        cv.notify_all();
+    }
+    reader.join();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+struct iovec;
+
+// Minimal io_uring (Linux 5.6+) on raw syscalls, no liburing. One submission
+// and one completion queue; not thread-safe, owners serialize calls. init()
+// fails where the kernel, a seccomp filter or the build has no io_uring, and
+// callers then stay on blocking I/O.
+class IoRing {
+public:
+    IoRing() = default;
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+    ~IoRing() { close(); }
+
+    bool init(unsigned entries);
+    void close();
+    bool ready() const { return fd_ >= 0; }
+    unsigned entries() const { return entries_; }
+
+    // Queue one operation at file offset off; false if the submission queue is
+    // full or a submit failed. `user` comes back with its completion.
+    bool read(int fd, void* p, std::size_t n, std::uint64_t off, std::uint64_t user);
+    bool writev(int fd, const struct iovec* iov, int n, std::uint64_t off, std::uint64_t user);
+
+    // Hands everything queued to the kernel. On failure the entries it did not
+    // take are withdrawn and nothing more can be queued; operations already
+    // submitted are still reaped.
+    bool submit();
+    // Next completion (submitting anything queued first); res is the byte count
+    // or -errno. wait = false returns false at once when nothing is complete;
+    // wait = true returns false once nothing is left in flight.
+    bool reap(std::uint64_t& user, int& res, bool wait);
+    unsigned in_flight() const { return inflight_; }   // submitted, not yet reaped
+
+private:
+    int fd_ = -1;
+    unsigned entries_ = 0;
+    unsigned queued_ = 0;   // prepared, not yet submitted
+    unsigned inflight_ = 0; // submitted, completion not yet reaped
+    bool failed_ = false;   // a submit failed: no new operations
+    void* sq_map_ = nullptr; std::size_t sq_map_len_ = 0;
+    void* cq_map_ = nullptr; std::size_t cq_map_len_ = 0;
+    void* sqes_ = nullptr;   std::size_t sqes_len_ = 0;
+    unsigned *sq_head_ = nullptr, *sq_tail_ = nullptr, *sq_mask_ = nullptr, *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr, *cq_mask_ = nullptr;
+    void* cqes_ = nullptr;
+
+    void* next_sqe();
+    int enter(unsigned submit, unsigned min_complete);
+};
@@ -0,0 +1,86 @@
+#include "arena.hpp"
+#include "sched.hpp"   // memory_limit
+#include <cstdlib>
+#include <mutex>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+constexpr int CLASSES = 24;                                 // 64 KiB .. 512 GiB
+constexpr std::size_t HUGE_PAGE = std::size_t(2) << 20;
+constexpr std::size_t MAX_POOLED = std::size_t(256) << 20;  // freed bytes kept without a memory limit
+
+struct FreeBuf { FreeBuf* next; };   // lives in the freed buffer itself
+
+std::mutex g_mu;
+FreeBuf* g_free[CLASSES] = {};
+ArenaStats g_stats;
+bool g_huge = false;
+
+// Class of an n-byte request, or -1 if it is too small (or too large) for one.
+int class_of(std::size_t n) {
+    if (n < ARENA_MIN_CLASS) return -1;
+    int k = 0;
+    while ((ARENA_MIN_CLASS << k) < n) if (++k == CLASSES) return -1;
+    return k;
+}
+
+void* heap_alloc(std::size_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (g_huge && size >= HUGE_PAGE) {
+        void* p = std::aligned_alloc(HUGE_PAGE, size);   // class sizes are multiples of it
+        if (!p) throw std::bad_alloc();
+        madvise(p, size, MADV_HUGEPAGE);   // best effort
+        return p;
+    }
+#endif
+    void* p = std::malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+} // namespace
+
+void* arena_alloc(std::size_t n) {
+    const int k = class_of(n);
+    if (k < 0) return ::operator new(n);
+    {
+        std::lock_guard<std::mutex> lk(g_mu);
+        if (FreeBuf* b = g_free[k]) {
+            g_free[k] = b->next;
+            g_stats.pooled -= ARENA_MIN_CLASS << k;
+            ++g_stats.reused;
+            return b;
+        }
+        ++g_stats.fresh;
+    }
+    return heap_alloc(ARENA_MIN_CLASS << k);
+}
+
+void arena_free(void* p, std::size_t n) {
+    if (!p) return;
+    const int k = class_of(n);
+    if (k < 0) { ::operator delete(p); return; }
+    const std::size_t size = ARENA_MIN_CLASS << k;
+    // an idle buffer still counts against the memory limit: keep a quarter of it
+    const std::size_t cap = memory_limit() ? memory_limit() / 4 : MAX_POOLED;
+    {
+        std::lock_guard<std::mutex> lk(g_mu);
+        if (g_stats.pooled + size <= cap) {
+            g_free[k] = ::new (p) FreeBuf{g_free[k]};
+            g_stats.pooled += size;
+            return;
+        }
+    }
+    std::free(p);
+}
+
+void set_huge_pages(bool on) { g_huge = on; }
+
+ArenaStats arena_stats() {
+    std::lock_guard<std::mutex> lk(g_mu);
+    return g_stats;
+}
@@ -0,0 +1,242 @@
+#include "bench.hpp"
+#include "huff.hpp"
+#include "crc32.hpp"   // crc32_kernel_name
+#include "threads.hpp" // encode_kernel_name
+#include "sched.hpp"   // cpu_topology
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// ---- reproducible corpora: everything derives from a fixed seed ----
+
+struct Rng {
+    std::uint64_t s;
+    std::uint64_t next() {   // splitmix64
+        std::uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    double unit() { return double(next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+// Cumulative Zipf weights over n ranks with exponent e.
+static std::vector<double> zipf_cdf(std::size_t n, double e) {
+    std::vector<double> cdf(n);
+    double sum = 0;
+    for (std::size_t k = 0; k < n; ++k) cdf[k] = sum += 1.0 / std::pow(double(k + 1), e);
+    for (double& c : cdf) c /= sum;
+    return cdf;
+}
+
+static std::size_t zipf_pick(const std::vector<double>& cdf, Rng& r) {
+    return std::size_t(std::lower_bound(cdf.begin(), cdf.end() - 1, r.unit()) - cdf.begin());
+}
+
+static void gen_random(std::vector<std::uint8_t>& out, std::size_t n) {
+    Rng r{1};
+    out.resize(n);
+    for (std::size_t i = 0; i < n; i += 8) {
+        std::uint64_t w = r.next();
+        std::memcpy(out.data() + i, &w, std::min<std::size_t>(8, n - i));
+    }
+}
+
+static void gen_zipf(std::vector<std::uint8_t>& out, std::size_t n) {
+    Rng r{2};
+    const auto cdf = zipf_cdf(256, 1.2);
+    out.resize(n);
+    for (auto& b : out) b = std::uint8_t(zipf_pick(cdf, r));
+}
+
+// Zipf-distributed words from a made-up vocabulary, wrapped into lines.
+static void gen_text(std::vector<std::uint8_t>& out, std::size_t n) {
+    Rng r{3};
+    std::vector<std::string> vocab(4096);
+    for (auto& w : vocab) {
+        const std::size_t len = 2 + r.next() % 9;
+        for (std::size_t k = 0; k < len; ++k) w += char('a' + r.next() % 26);
+    }
+    const auto cdf = zipf_cdf(vocab.size(), 1.0);
+    out.clear();
+    out.reserve(n + 16);
+    std::size_t line = 0;
+    while (out.size() < n) {
+        const std::string& w = vocab[zipf_pick(cdf, r)];
+        out.insert(out.end(), w.begin(), w.end());
+        line += w.size() + 1;
+        if (line > 72) { out.push_back('\n'); line = 0; }
+        else out.push_back(r.next() % 16 ? ' ' : ',');
+    }
+    out.resize(n);
+}
+
+static void gen_same(std::vector<std::uint8_t>& out, std::size_t n) {
+    out.assign(n, 'a');
+}
+
+// huff's own output for the text corpus, repeated to size.
+static void gen_compressed(std::vector<std::uint8_t>& out, std::size_t n) {
+    std::vector<std::uint8_t> text;
+    gen_text(text, n);
+    std::vector<std::uint8_t> packed(compress_bound(n));
+    std::size_t len = 0;
+    HuffContext ctx;
+    compress_buffer(ctx, text.data(), n, packed.data(), packed.size(), len);
+    out.resize(n);
+    for (std::size_t i = 0; i < n && len; i += len)
+        std::memcpy(out.data() + i, packed.data(), std::min(len, n - i));
+}
+
+struct Corpus {
+    const char* name;
+    void (*gen)(std::vector<std::uint8_t>&, std::size_t);
+};
+
+constexpr Corpus CORPORA[] = {
+    {"random",     gen_random},
+    {"zipf",       gen_zipf},
+    {"text",       gen_text},
+    {"same",       gen_same},
+    {"compressed", gen_compressed},
+};
+
+// ---- measurement ----
+
+struct Result {
+    std::string corpus;
+    int threads = 0;
+    std::size_t raw = 0, packed = 0;
+    double comp_s = 0, decomp_s = 0;   // fastest run
+    double comp_eff = 0, decomp_eff = 0;
+};
+
+static double mbps(std::size_t bytes, double s) { return s > 0 ? double(bytes) / 1e6 / s : 0; }
+
+template <class Fn>
+static double best_of(int iters, Fn fn) {
+    double best = 1e300;
+    for (int i = 0; i < iters; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - t0;
+        best = std::min(best, d.count());
+    }
+    return best;
+}
+
+static int write_json(const BenchOptions& opt, const std::vector<Result>& rs, int cores) {
+    std::FILE* f = opt.json == "-" ? stdout : std::fopen(opt.json.c_str(), "w");
+    if (!f) return 1;
+    std::fprintf(f, "{\n  \"size\": %zu,\n  \"iters\": %d,\n  \"cores\": %d,\n  \"crc32\": \"%s\",\n"
+                    "  \"encode\": \"%s\",\n  \"results\": [\n",
+                 opt.size, opt.iters, cores, crc32_kernel_name(), encode_kernel_name());
+    for (std::size_t i = 0; i < rs.size(); ++i) {
+        const Result& r = rs[i];
+        std::fprintf(f, "    {\"corpus\": \"%s\", \"threads\": %d, \"raw\": %zu, \"compressed\": %zu, "
+                        "\"ratio\": %.4f, \"compress_mbps\": %.1f, \"decompress_mbps\": %.1f, "
+                        "\"compress_eff\": %.3f, \"decompress_eff\": %.3f}%s\n",
+                     r.corpus.c_str(), r.threads, r.raw, r.packed,
+                     double(r.packed) / double(std::max<std::size_t>(1, r.raw)),
+                     mbps(r.raw, r.comp_s), mbps(r.raw, r.decomp_s), r.comp_eff, r.decomp_eff,
+                     i + 1 < rs.size() ? "," : "");
+    }
+    std::fprintf(f, "  ]\n}\n");
+    if (f == stdout) return std::fflush(f) == 0 ? 0 : 1;
+    return std::fclose(f) == 0 ? 0 : 1;
+}
+
+} // namespace
+
+const std::vector<std::string>& bench_corpora() {
+    static const std::vector<std::string> names = [] {
+        std::vector<std::string> v;
+        for (const Corpus& c : CORPORA) v.push_back(c.name);
+        return v;
+    }();
+    return names;
+}
+
+int run_bench(const BenchOptions& opt) {
+    const int cores = cpu_topology().cpus;
+    std::vector<int> threads = opt.threads;
+    if (threads.empty())
+        for (int t = 1; ; t *= 2) { threads.push_back(std::min(t, cores)); if (t >= cores) break; }
+    const std::vector<std::string>& names = opt.corpora.empty() ? bench_corpora() : opt.corpora;
+    const int iters = std::max(1, opt.iters);
+
+    // table to stdout unless the JSON goes there
+    std::FILE* out = opt.json == "-" ? stderr : stdout;
+    if (!opt.kernel.empty() && !set_encode_kernel(opt.kernel.c_str())) {
+        std::fprintf(stderr, "Encode kernel '%s' is unknown or not supported here.\n", opt.kernel.c_str());
+        return 1;
+    }
+    std::fprintf(out, "huff bench: %zu bytes per corpus, best of %d, %d core%s, crc32 %s, encode %s\n\n",
+                 opt.size, iters, cores, cores == 1 ? "" : "s", crc32_kernel_name(), encode_kernel_name());
+    std::fprintf(out, "%-11s %7s %7s %14s %6s %16s %6s\n",
+                 "corpus", "threads", "ratio", "compress MB/s", "eff", "decompress MB/s", "eff");
+
+    std::vector<Result> results;
+    std::vector<std::uint8_t> raw, packed, back;
+    for (const std::string& name : names) {
+        const Corpus* c = nullptr;
+        for (const Corpus& k : CORPORA) if (name == k.name) c = &k;
+        if (!c) { std::fprintf(stderr, "Unknown corpus '%s'.\n", name.c_str()); return 1; }
+        c->gen(raw, opt.size);
+        packed.resize(compress_bound(raw.size()));
+        back.resize(raw.size());
+
+        const std::size_t first = results.size();
+        for (int t : threads) {
+            HuffContext ctx(t);
+            std::size_t plen = 0, blen = 0;
+            int rc = 0;
+
+            // untimed first pass: warms the context and checks the round trip
+            if ((rc = compress_buffer(ctx, raw.data(), raw.size(), packed.data(), packed.size(), plen)) ||
+                (rc = decompress_buffer(ctx, packed.data(), plen, back.data(), back.size(), blen)))
+                return rc;
+            if (blen != raw.size() || std::memcmp(back.data(), raw.data(), blen) != 0) {
+                std::fprintf(stderr, "Round trip mismatch on '%s' (%d threads).\n", c->name, t);
+                return 10;
+            }
+
+            Result r;
+            r.corpus = c->name;
+            r.threads = t;
+            r.raw = raw.size();
+            r.packed = plen;
+            r.comp_s = best_of(iters, [&] {
+                compress_buffer(ctx, raw.data(), raw.size(), packed.data(), packed.size(), plen);
+            });
+            r.decomp_s = best_of(iters, [&] {
+                decompress_buffer(ctx, packed.data(), plen, back.data(), back.size(), blen);
+            });
+
+            // scaling efficiency: speedup over the first thread count, per added thread
+            const Result& base = results.size() > first ? results[first] : r;
+            const double scale = double(base.threads) / double(t);
+            r.comp_eff   = base.comp_s / r.comp_s * scale;
+            r.decomp_eff = base.decomp_s / r.decomp_s * scale;
+            results.push_back(r);
+
+            std::fprintf(out, "%-11s %7d %7.3f %14.1f %6.2f %16.1f %6.2f\n",
+                         c->name, t, double(plen) / double(std::max<std::size_t>(1, raw.size())),
+                         mbps(r.raw, r.comp_s), r.comp_eff, mbps(r.raw, r.decomp_s), r.decomp_eff);
+        }
+    }
+
+    if (!opt.json.empty() && write_json(opt, results, cores) != 0) {
+        std::fprintf(stderr, "Cannot write '%s'.\n", opt.json.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -1,26 +1,66 @@
 #include "bitio.hpp"
+#include <cstring>
 
-void BitWriter::write_bit(int b) {
-    buf = static_cast<uint8_t>((buf << 1) | (b & 1));
-    bits++;
-    if (bits == 8) {
-        std::fputc(buf, f);
-        bits = 0; buf = 0;
+void BitWriter::put32(std::uint32_t w) {
+    std::size_t at = out.size();
+    out.resize(at + 4);
+    out[at]     = std::uint8_t(w >> 24);
+    out[at + 1] = std::uint8_t(w >> 16);
+    out[at + 2] = std::uint8_t(w >> 8);
+    out[at + 3] = std::uint8_t(w);
+    if (out.size() >= OUT_CAP) spill();
+}
+
+void BitWriter::spill() {
+    if (!out.empty()) std::fwrite(out.data(), 1, out.size(), f);
+    out.clear();
+}
+
+void BitWriter::drain_bytes() {
+    while (bits >= 8) {
+        bits -= 8;
+        out.push_back(std::uint8_t(acc >> bits));
     }
 }
 
 void BitWriter::write_bits(uint32_t v, int n) {
-    for (int i = n - 1; i >= 0; --i) {
-        write_bit((v >> i) & 1);
+    if (n <= 0) return;
+    acc = (acc << n) | (std::uint64_t(v) & ((std::uint64_t(1) << n) - 1));
+    bits += n;
+    if (bits >= 32) {
+        bits -= 32;
+        put32(std::uint32_t(acc >> bits));
+    }
+}
+
+void BitWriter::write_bytes(const std::uint8_t* p, std::size_t n) {
+    if (bits % 8 == 0) {
+        // byte-aligned: plain copy
+        drain_bytes();
+        if (n >= OUT_CAP) {
+            spill();
+            std::fwrite(p, 1, n, f);
+            return;
+        }
+        out.insert(out.end(), p, p + n);
+        if (out.size() >= OUT_CAP) spill();
+        return;
     }
+    // unaligned: shift-merge a 32-bit word at a time
+    for (; n >= 4; p += 4, n -= 4)
+        write_bits((std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+                   (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]), 32);
+    for (; n > 0; ++p, --n) write_bits(*p, 8);
 }
 
 void BitWriter::flush() {
+    drain_bytes();
     if (bits > 0) {
-        buf <<= (8 - bits);
-        std::fputc(buf, f);
-        bits = 0; buf = 0;
+        out.push_back(std::uint8_t(acc << (8 - bits)));
+        bits = 0;
     }
+    acc = 0;
+    spill();
 }
 
 int BitReader::read_bit() {
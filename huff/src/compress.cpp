@@ -2,203 +2,659 @@
 #include "huff.hpp"
 #include "bitio.hpp"
 #include "crc32.hpp"
-#include "threads.hpp"   // Codeword + MemBitWriter + encode_chunks_parallel
+#include "threads.hpp"   // Codeword + MemBitWriter + encode_chunk + run_pipeline
+#include "format.hpp"
+#include "io.hpp"
+#include "hist.hpp"
+#include "context.hpp"
+#include "stats.hpp"
+#include "sched.hpp"
 
 #include <cstdint>
 #include <cstdio>
 #include <array>
 #include <vector>
-#include <queue>
+#include <span>
 #include <algorithm>
-#include <thread>        // for hardware_concurrency
-#include <cstring>       // optional for perror if you add more diagnostics
+#include <atomic>
+#include <cstring>
 
 namespace {
 
-// --- constants ---
-static const uint8_t MAGIC[4] = {'H','U','F','1'};
+// --- output: a FILE, or a caller buffer that records overflow ---
+struct Sink {
+    std::FILE* f = nullptr;
+    std::uint8_t* buf = nullptr;
+    std::size_t cap = 0, len = 0;
+    bool overflow = false;
+
+    void put(const void* p, std::size_t n) {
+        if (n == 0) return;
+        if (f) { std::fwrite(p, 1, n, f); return; }
+        if (n > cap - len) { overflow = true; return; }
+        std::memcpy(buf + len, p, n);
+        len += n;
+    }
+    void put_byte(std::uint8_t b) { put(&b, 1); }
+};
 
-// --- helpers ---
-static inline void write_u64_le(std::FILE* f, std::uint64_t x) {
-    for (int i = 0; i < 8; ++i) { std::fputc(int(x & 0xFF), f); x >>= 8; }
+static inline void write_u64_le(Sink& s, std::uint64_t x) {
+    std::uint8_t b[8];
+    for (int i = 0; i < 8; ++i) { b[i] = std::uint8_t(x & 0xFF); x >>= 8; }
+    s.put(b, 8);
 }
-static inline void write_u32_le(std::FILE* f, std::uint32_t x) {
-    for (int i = 0; i < 4; ++i) { std::fputc(int(x & 0xFF), f); x >>= 8; }
+static inline void write_u32_le(Sink& s, std::uint32_t x) {
+    std::uint8_t b[4];
+    for (int i = 0; i < 4; ++i) { b[i] = std::uint8_t(x & 0xFF); x >>= 8; }
+    s.put(b, 4);
 }
 
-// --- Huffman node ---
-struct Node {
-    std::uint64_t freq;
-    int sym; // 0..255 leaf, -1 internal
-    Node* left;
-    Node* right;
-    Node(std::uint64_t f,int s,Node*L=nullptr,Node*R=nullptr):freq(f),sym(s),left(L),right(R){}
-};
-
-struct Cmp {
-    bool operator()(const Node* a, const Node* b) const {
-        if (a->freq != b->freq) return a->freq > b->freq; // min-heap
-        int as = (a->sym >= 0 ? a->sym : 256);
-        int bs = (b->sym >= 0 ? b->sym : 256);
-        return as > bs;
-    }
-};
+// Stored-block threshold: a block is kept raw unless coding saves at least
+// 1/STORE_MIN_GAIN of it, since a raw block also decodes at memcpy speed.
+constexpr std::uint64_t STORE_MIN_GAIN = 64;
 
-static void free_tree(Node* n) {
-    if (!n) return;
-    free_tree(n->left);
-    free_tree(n->right);
-    delete n;
+static bool should_store(std::uint64_t coded_bytes, std::size_t raw_len) {
+    return coded_bytes + raw_len / STORE_MIN_GAIN >= raw_len;
 }
 
-// DFS to compute code lengths
-static void gather_lengths(Node* n, int depth, std::array<uint8_t,256>& lens) {
-    if (!n) return;
-    if (n->sym >= 0) {
-        // Single-symbol file => assign length 1
-        lens[size_t(n->sym)] = uint8_t(depth == 0 ? 1 : depth);
-        return;
-    }
-    gather_lengths(n->left,  depth+1, lens);
-    gather_lengths(n->right, depth+1, lens);
+// Blocks smaller than this stay single-stream: the jump table and per-stream
+// padding would outweigh the faster decode.
+constexpr std::size_t MULTI_STREAM_MIN = 4096;
+
+static int block_streams(int streams, std::size_t raw_len) {
+    return raw_len >= MULTI_STREAM_MIN ? std::clamp(streams, 1, HUF2_MAX_STREAMS) : 1;
 }
 
-// ---- canonical codes from lengths (matches decoder) ----
-struct Code { uint32_t code=0; uint8_t len=0; };
+// Single stream, or jump table + sub-streams when streams > 1.
+static void encode_block(const std::uint8_t* p, std::size_t len,
+                         const std::array<Codeword,256>& table, int streams, MemBitWriter& mbw) {
+    if (streams > 1) encode_chunk_streams(p, len, table, streams, mbw);
+    else             encode_chunk(p, len, table, mbw);
+}
 
-static std::array<Code,256> build_canonical(const std::array<uint8_t,256>& lens) {
-    struct L { uint8_t len; int sym; };
-    std::vector<L> items; items.reserve(256);
-    for (int s=0; s<256; ++s) if (lens[s] > 0) items.push_back({lens[s], s});
+// Codeword table for the threads API
+static std::array<Codeword,256> codeword_table(const std::array<uint8_t,256>& lengths) {
+    std::array<std::uint32_t,256> codes;
+    canonical_codes(lengths, codes);
+    std::array<Codeword,256> table{};
+    for (int s = 0; s < 256; ++s) {
+        table[s].code = codes[s];
+        table[s].len  = lengths[s];
+    }
+    return table;
+}
 
-    // Sort by length, then by symbol
-    std::sort(items.begin(), items.end(), [](const L& a, const L& b){
-        if (a.len != b.len) return a.len < b.len;
-        return a.sym < b.sym;
-    });
+static void write_block_header(Sink& fo, BlockType type, std::uint32_t raw_len,
+                               std::uint32_t comp_len, std::uint32_t crc) {
+    fo.put_byte(type);
+    write_u32_le(fo, raw_len);
+    write_u32_le(fo, comp_len);
+    write_u32_le(fo, crc);
+}
 
-    std::array<Code,256> out{}; // zero-init
-    if (items.empty()) return out;
+// A block slot's positional write in flight; the slot is not refilled until it is done.
+struct BlockWrite {
+    std::uint8_t head[HUF2_BLOCK_HEADER_SIZE];
+    std::atomic<bool> busy{false};
+    PositionalOutput* queued = nullptr;   // set while the write sits on an io_uring
 
-    uint32_t code = 0;
-    int prev_len = items.front().len;
+    void wait() {
+        if (queued) queued->wait(busy);   // completions are reaped by whoever waits
+        else        busy.wait(true, std::memory_order_acquire);
+    }
+};
 
-    // First symbol gets code 0 of its length
-    out[items.front().sym] = {code, (uint8_t)prev_len};
+// ---- HUF2 block writer: blocks are laid out in order, the index is kept for the tail ----
+// Through a Sink every byte goes out in order. With a PositionalOutput each
+// block is only placed in order; header + body then go to its offset with one
+// pwrite, on the pool when `async`, so several blocks are written at once, or
+// queued on the output's io_uring (uring backend).
+struct Huf2Writer {
+    Sink* fo = nullptr;
+    PositionalOutput* po = nullptr;
+    bool async = false;
+    std::vector<std::uint64_t>& offsets;   // index entries, kept by the caller for reuse
+    std::vector<std::uint32_t>& raw_lens;
+    std::uint64_t pos = HUF2_HEADER_SIZE;  // bytes laid out so far (the file size after finish())
+    std::uint64_t total = 0;
+    std::uint32_t crc = 0;   // CRC32 of everything so far, merged block by block
+
+    Huf2Writer(Sink& f, std::vector<std::uint64_t>& offs, std::vector<std::uint32_t>& lens)
+        : fo(&f), offsets(offs), raw_lens(lens) { offsets.clear(); raw_lens.clear(); }
+    Huf2Writer(PositionalOutput& out, bool in_parallel,
+               std::vector<std::uint64_t>& offs, std::vector<std::uint32_t>& lens)
+        : po(&out), async(in_parallel), offsets(offs), raw_lens(lens) { offsets.clear(); raw_lens.clear(); }
+
+    void header(std::size_t block_size, const std::array<uint8_t,256>& lengths) {
+        Sink& s = staged(HUF2_HEADER_SIZE);
+        s.put(HUF2_MAGIC, 4);
+        write_u32_le(s, (std::uint32_t)block_size);
+        s.put(lengths.data(), 256);
+        unstage(0);
+        pos = HUF2_HEADER_SIZE;
+    }
 
-    // Progress for the rest: increment, then shift if length increased
-    for (size_t i = 1; i < items.size(); ++i) {
-        const auto& it = items[i];
-        code += 1;
-        if (it.len > prev_len) {
-            code <<= (it.len - prev_len);
-            prev_len = it.len;
-        }
-        out[it.sym] = {code, it.len};
+    // HUFD: the file-wide table is a registered shared table, named by ID
+    void header_shared(std::size_t block_size, std::uint32_t table_id) {
+        Sink& s = staged(HUFD_HEADER_SIZE);
+        s.put(HUFD_MAGIC, 4);
+        write_u32_le(s, (std::uint32_t)block_size);
+        write_u32_le(s, table_id);
+        unstage(0);
+        pos = HUFD_HEADER_SIZE;
     }
-    return out;
-}
 
-} // namespace
+    // table: per-block code lengths (BLOCK_HUFF_TABLE*), or null for the header table;
+    // multi: bytes start with a jump table (see encode_chunk_streams);
+    // w: the slot's write state, needed with a PositionalOutput only
+    void coded(const std::uint8_t* table, bool multi, const ByteBuf& bytes,
+               std::size_t raw_len, std::uint32_t block_crc, BlockWrite* w = nullptr) {
+        const std::size_t body = (table ? 256 : 0) + bytes.size();
+        const BlockType type = table ? (multi ? BLOCK_HUFF_TABLE_MULTI : BLOCK_HUFF_TABLE)
+                                     : (multi ? BLOCK_HUFF_MULTI : BLOCK_HUFF);
+        block(type, raw_len, body, block_crc, w,
+              {table, table ? std::size_t(256) : 0}, {bytes.data(), bytes.size()});
+    }
 
-int compress_file(const char* in_path, const char* out_path, int /*level*/) {
-    // --- open input ---
-    std::FILE* fi = std::fopen(in_path, "rb");
-    if (!fi) {
-        // std::perror("compress fopen input");
-        return 1;
+    void stored(const std::uint8_t* raw, std::size_t raw_len, std::uint32_t block_crc,
+                BlockWrite* w = nullptr) {
+        block(BLOCK_STORED, raw_len, raw_len, block_crc, w, {}, {raw, raw_len});
     }
 
-    // --- read whole input (simple baseline; later you can stream) ---
-    std::vector<uint8_t> data;
-    std::array<std::uint64_t,256> freq{}; freq.fill(0);
+    // END marker, index and footer
+    void finish() {
+        const std::uint64_t index_offset = pos + HUF2_BLOCK_HEADER_SIZE;
+        const std::size_t tail = HUF2_BLOCK_HEADER_SIZE + offsets.size() * HUF2_INDEX_ENTRY_SIZE
+                               + HUF2_FOOTER_SIZE;
+        Sink& s = staged(tail);
+        write_block_header(s, BLOCK_END, 0, 0, 0);
+
+        // --- index ---
+        for (std::size_t i = 0; i < offsets.size(); ++i) {
+            write_u64_le(s, offsets[i]);
+            write_u32_le(s, raw_lens[i]);
+        }
 
-    uint8_t buf[1<<14];
-    size_t n;
-    while ((n = std::fread(buf, 1, sizeof buf, fi)) > 0) {
-        data.insert(data.end(), buf, buf + n);
-        for (size_t i=0;i<n;++i) freq[buf[i]]++;
+        // --- footer ---
+        write_u64_le(s, total);
+        write_u32_le(s, crc);
+        write_u32_le(s, (std::uint32_t)offsets.size());
+        write_u64_le(s, index_offset);
+        s.put(HUF2_MAGIC, 4);
+        unstage(pos);
+        pos += tail;
     }
-    std::fclose(fi);
 
-    std::uint64_t orig_size = (std::uint64_t)data.size();
+private:
+    std::vector<std::uint8_t> staging;   // header / tail bytes for a PositionalOutput
+    Sink stage_sink;
+
+    Sink& staged(std::size_t n) {
+        if (!po) return *fo;
+        staging.resize(n);
+        stage_sink = Sink{};
+        stage_sink.buf = staging.data();
+        stage_sink.cap = n;
+        return stage_sink;
+    }
+    void unstage(std::uint64_t off) {
+        if (!po) return;
+        const IoPiece piece{staging.data(), stage_sink.len};
+        po->write_at(off, &piece, 1);
+    }
 
-    // --- open output ---
-    std::FILE* fo = std::fopen(out_path, "wb");
-    if (!fo) {
-        // std::perror("compress fopen output");
-        return 2;
+    void block(BlockType type, std::size_t raw_len, std::size_t body, std::uint32_t block_crc,
+               BlockWrite* w, IoPiece a, IoPiece b) {
+        const std::uint64_t at = pos;
+        offsets.push_back(pos);
+        raw_lens.push_back((std::uint32_t)raw_len);
+        pos += HUF2_BLOCK_HEADER_SIZE + body;
+        total += raw_len;
+        crc = crc32_combine(crc, block_crc, raw_len);
+
+        if (!po) {
+            StageTimer st(STAGE_WRITE, raw_len);
+            write_block_header(*fo, type, (std::uint32_t)raw_len, (std::uint32_t)body, block_crc);
+            fo->put(a.p, a.n);
+            fo->put(b.p, b.n);
+            return;
+        }
+        Sink hs;
+        hs.buf = w->head;
+        hs.cap = HUF2_BLOCK_HEADER_SIZE;
+        write_block_header(hs, type, (std::uint32_t)raw_len, (std::uint32_t)body, block_crc);
+
+        if (po->queued()) {
+            StageTimer st(STAGE_WRITE, raw_len);   // submission only: the kernel does the rest
+            const IoPiece pieces[3] = {{w->head, HUF2_BLOCK_HEADER_SIZE}, a, b};
+            w->queued = po;
+            w->busy.store(true, std::memory_order_relaxed);
+            po->write_queued(at, pieces, 3, &w->busy);
+            return;
+        }
+        auto write = [po = po, w, at, a, b, raw_len] {
+            StageTimer st(STAGE_WRITE, raw_len);
+            const IoPiece pieces[3] = {{w->head, HUF2_BLOCK_HEADER_SIZE}, a, b};
+            po->write_at(at, pieces, 3);
+        };
+        if (!async) { write(); return; }
+        w->busy.store(true, std::memory_order_relaxed);
+        ThreadPool::instance().submit([write, w] {
+            write();
+            w->busy.store(false, std::memory_order_release);
+            w->busy.notify_all();
+        });
     }
+};
 
+// ---- HUF1 header; the stitched bitstream follows ----
+static void write_huf1_header(Sink& fo, const std::array<uint8_t,256>& lengths,
+                              std::uint64_t orig_size, std::uint64_t total_bits,
+                              std::uint32_t crc) {
     // --- write magic + size ---
-    std::fwrite(MAGIC, 1, 4, fo);
+    fo.put(HUF1_MAGIC, 4);
     write_u64_le(fo, orig_size);
 
-    // --- empty file: write zero lengths + pad_bits=0 + crc=0 and return ---
-    if (orig_size == 0) {
-        std::array<uint8_t,256> zero{}; zero.fill(0);
-        std::fwrite(zero.data(), 1, 256, fo);
-        std::fputc(0, fo);               // pad_bits
-        write_u32_le(fo, 0x00000000u);   // CRC32 of empty by our wrapper
-        std::fclose(fo);
-        return 0;
+    // --- write lengths[256] ---
+    fo.put(lengths.data(), 256);
+
+    // --- header tail: pad_bits + crc32 ---
+    uint8_t pad_bits = uint8_t((8 - (total_bits % 8)) % 8);
+    fo.put_byte(pad_bits);
+    write_u32_le(fo, crc);
+}
+
+// ---- streaming HUF2: fixed-size blocks, each with its own code table ----
+// A reader thread fills a ring of w.slots blocks, the pool builds a table
+// for each and codes it, and blocks are placed strictly front to back as
+// soon as they are done, so pipes work on both ends and memory stays bounded.
+// With a shared table every block is coded with it: no histogram, no per-block lengths.
+static void compress_stream(std::FILE* fi, Huf2Writer& out, const WorkPlan& w,
+                            int max_code_len, int streams, const SharedTable* shared) {
+    const std::size_t block_size = w.block_size;
+    struct Block {
+        ByteBuf raw;   // arena: refilled by fread, never zeroed
+        std::array<uint8_t,256> lengths{};
+        MemBitWriter enc;
+        std::uint32_t crc = 0;
+        bool stored = false;
+        int streams = 1;
+        BlockWrite w;
+    };
+    std::vector<Block> ring(w.slots);
+
+    std::array<uint8_t,256> zero{}; zero.fill(0);   // no file-wide table
+    std::array<Codeword,256> shared_codes{};
+    if (shared) {
+        shared_codes = codeword_table(shared->lengths);
+        out.header_shared(block_size, shared->id);
+    } else {
+        out.header(block_size, zero);
     }
 
-    // --- build tree ---
-    std::priority_queue<Node*, std::vector<Node*>, Cmp> pq;
-    for (int s=0;s<256;++s) if (freq[s] > 0) pq.push(new Node(freq[s], s));
-    if (pq.size() == 1) { // single symbol → add dummy parent
-        Node* a = pq.top(); pq.pop();
-        pq.push(new Node(a->freq, -1, a, nullptr));
+    bool eof = false;
+    run_pipeline(ring,
+        // --- read ---
+        [&](Block& b) {
+            b.w.wait();
+            if (eof) return false;
+            StageTimer st(STAGE_READ, 0);
+            b.raw.resize(block_size);
+            std::size_t got = std::fread(b.raw.data(), 1, block_size, fi);
+            b.raw.resize(got);
+            st.bytes = got;
+            if (got < block_size) eof = true;
+            return got > 0;
+        },
+        // --- histogram, table and encode ---
+        [&](Block& b) {
+            b.enc.reset();
+            b.streams = block_streams(streams, b.raw.size());
+            if (shared) {
+                {
+                    StageTimer st(STAGE_CRC, b.raw.size());
+                    b.crc = crc32(b.raw.data(), b.raw.size());
+                }
+                StageTimer st(STAGE_ENCODE, b.raw.size());
+                encode_block(b.raw.data(), b.raw.size(), shared_codes, b.streams, b.enc);
+                b.stored = should_store(b.enc.bytes.size(), b.raw.size());
+                return;
+            }
+            std::array<std::uint64_t,256> freq{}; freq.fill(0);
+            {
+                StageTimer st(STAGE_HIST, b.raw.size());
+                b.crc = count_bytes(b.raw.data(), b.raw.size(), freq);
+            }
+            {
+                StageTimer st(STAGE_TABLE, 0);
+                b.lengths = code_lengths(freq, max_code_len);
+            }
+            b.stored = should_store(256 + stream_jump_table_size(b.streams) + (coded_bits(freq, b.lengths) + 7) / 8,
+                                    b.raw.size());
+            if (b.stored) return;
+            StageTimer st(STAGE_ENCODE, b.raw.size());
+            encode_block(b.raw.data(), b.raw.size(), codeword_table(b.lengths), b.streams, b.enc);
+        },
+        // --- write ---
+        [&](Block& b) {
+            if (b.stored) out.stored(b.raw.data(), b.raw.size(), b.crc, &b.w);
+            else          out.coded(shared ? nullptr : b.lengths.data(), b.streams > 1, b.enc.bytes,
+                                    b.raw.size(), b.crc, &b.w);
+        });
+
+    for (Block& b : ring) b.w.wait();
+    out.finish();
+}
+
+// ---- whole input in memory: one table for all chunks ----
+struct Plan {
+    std::array<std::uint64_t,256> freq{};
+    std::array<uint8_t,256> lengths{};
+    std::array<Codeword,256> table{};
+    std::uint32_t crc = 0;   // CRC32 of all input
+    int streams = 1;         // requested sub-streams (HUF1: always 1)
+    const SharedTable* shared = nullptr;   // HUFD: table comes from opt.table
+    std::size_t block_size = HUF2_BLOCK_SIZE;   // raw bytes per chunk (plan_work)
+    // Under a memory limit: the mapped input, whose pages are released as
+    // passes finish with them, and the chunks a pass covers before it does.
+    const MappedInput* input = nullptr;
+    std::size_t window = 0;
+};
+
+// Pass over [0, n) chunks a window at a time, releasing each window's input
+// pages after it; all at once without a limit.
+template <class F>
+static void by_window(const Plan& p, std::size_t n, F&& f) {
+    const std::size_t step = p.input && p.window ? p.window : std::max<std::size_t>(n, 1);
+    for (std::size_t a = 0; a < n; a += step) {
+        const std::size_t b = std::min(n, a + step);
+        f(a, b);
+        if (p.input) p.input->release(a * p.block_size, (b - a) * p.block_size);
     }
-    while (pq.size() > 1) {
-        Node* a = pq.top(); pq.pop();
-        Node* b = pq.top(); pq.pop();
-        pq.push(new Node(a->freq + b->freq, -1, a, b));
+}
+
+static std::span<const uint8_t> chunk_at(std::span<const uint8_t> data, const Plan& p, std::size_t i) {
+    return data.subspan(i * p.block_size, std::min(p.block_size, data.size() - i * p.block_size));
+}
+
+// File-wide table from a histogram of all input.
+static void plan_histogram(std::span<const uint8_t> data, const CompressOptions& opt, int threads,
+                           HuffContext::Scratch& s, Plan& p) {
+    // --- histogram + per-chunk CRC in one parallel pass ---
+    p.freq.fill(0);
+    if (!p.input) {
+        histogram_parallel(data, p.block_size, threads, p.freq, s.chunk_crcs, &s.chunk_freqs);
+    } else {
+        const std::size_t nchunks = (data.size() + p.block_size - 1) / p.block_size;
+        s.chunk_crcs.resize(nchunks);
+        s.chunk_freqs.resize(nchunks);
+        std::vector<std::uint32_t> crcs;
+        std::vector<std::array<std::uint64_t,256>> freqs;
+        by_window(p, nchunks, [&](std::size_t a, std::size_t b) {
+            const std::size_t off = a * p.block_size;
+            histogram_parallel(data.subspan(off, std::min((b - a) * p.block_size, data.size() - off)),
+                               p.block_size, threads, p.freq, crcs, &freqs);
+            std::copy(crcs.begin(), crcs.end(), s.chunk_crcs.begin() + (std::ptrdiff_t)a);
+            std::copy(freqs.begin(), freqs.end(), s.chunk_freqs.begin() + (std::ptrdiff_t)a);
+        });
     }
-    Node* root = pq.top();
 
     // --- lengths + canonical codes ---
-    std::array<uint8_t,256> lengths{}; lengths.fill(0);
-    gather_lengths(root, 0, lengths);
-    auto codes = build_canonical(lengths);
+    {
+        StageTimer st(STAGE_TABLE, 0);
+        p.lengths = code_lengths(p.freq, opt.max_code_len);
+        p.table = codeword_table(p.lengths);
+    }
 
-    // --- write lengths[256] ---
-    std::fwrite(lengths.data(), 1, 256, fo);
+    // --- HUF2: chunks the file-wide table would not shrink are stored raw ---
+    const std::size_t nchunks = s.chunk_crcs.size();
+    s.stored.assign(nchunks, 0);
+    if (opt.format != 1)
+        for (std::size_t i = 0; i < nchunks; ++i)
+            s.stored[i] = should_store((coded_bits(s.chunk_freqs[i], p.lengths) + 7) / 8,
+                                       chunk_at(data, p, i).size());
+}
 
-    // --- compute header tail: total_bits, pad_bits, CRC32(original) ---
-    std::uint64_t total_bits = 0;
-    for (uint8_t b : data) total_bits += lengths[b];
-    uint8_t pad_bits = uint8_t((8 - (total_bits % 8)) % 8);
+// Histogram + per-chunk CRC, code table, and which chunks HUF2 stores raw.
+// A shared table skips the histogram: chunks are only checksummed, and which
+// ones to store is decided once they are coded (encode_planned).
+static void plan_chunks(std::span<const uint8_t> data, const CompressOptions& opt, int threads,
+                        std::size_t block_size, HuffContext::Scratch& s, Plan& p) {
+    p.streams = opt.format == 1 ? 1 : opt.streams;   // HUF1 is one bitstream
+    p.shared = opt.table;
+    p.block_size = block_size;
+    const std::size_t nchunks = (data.size() + block_size - 1) / block_size;
+
+    if (p.shared) {
+        s.chunk_crcs.resize(nchunks);
+        by_window(p, nchunks, [&](std::size_t a, std::size_t b) {
+            parallel_for(b - a, threads, [&](std::size_t k) {
+                auto in = chunk_at(data, p, a + k);
+                StageTimer st(STAGE_CRC, in.size());
+                s.chunk_crcs[a + k] = crc32(in.data(), in.size());
+            });
+        });
+        p.lengths = p.shared->lengths;
+        p.table = codeword_table(p.lengths);
+        s.stored.assign(nchunks, 0);
+    } else {
+        plan_histogram(data, opt, threads, s, p);
+    }
 
-    std::uint32_t crc = crc32(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    // --- combined CRC from the chunk CRCs ---
+    p.crc = 0;
+    for (std::size_t i = 0; i < nchunks; ++i)
+        p.crc = crc32_combine(p.crc, s.chunk_crcs[i], chunk_at(data, p, i).size());
+}
 
-    // --- write pad_bits + crc32 ---
-    std::fputc(pad_bits, fo);
-    write_u32_le(fo, crc);
+static void encode_planned(std::span<const uint8_t> data, const Plan& p,
+                           HuffContext::Scratch& s, std::size_t i, MemBitWriter& enc) {
+    enc.reset();
+    if (s.stored[i]) return;
+    auto in = chunk_at(data, p, i);
+    StageTimer st(STAGE_ENCODE, in.size());
+    encode_block(in.data(), in.size(), p.table, block_streams(p.streams, in.size()), enc);
+    if (p.shared) s.stored[i] = should_store(enc.bytes.size(), in.size());   // one byte per chunk: no race
+}
 
-    // --- parallel payload encode into chunks, then stitch into final BitWriter ---
-    // Build Codeword table for threads API
-    std::array<Codeword,256> table{};
-    for (int s = 0; s < 256; ++s) {
-        table[s].code = codes[s].code;
-        table[s].len  = codes[s].len;
+static void write_planned(Huf2Writer& out, std::span<const uint8_t> data, const Plan& p,
+                          const HuffContext::Scratch& s, std::size_t i, const MemBitWriter& enc,
+                          BlockWrite* w = nullptr) {
+    auto in = chunk_at(data, p, i);
+    if (s.stored[i]) out.stored(in.data(), in.size(), s.chunk_crcs[i], w);
+    else             out.coded(nullptr, block_streams(p.streams, in.size()) > 1, enc.bytes,
+                               in.size(), s.chunk_crcs[i], w);
+}
+
+static void write_plan_header(Huf2Writer& out, const Plan& p) {
+    if (p.shared) out.header_shared((std::uint32_t)p.block_size, p.shared->id);
+    else          out.header((std::uint32_t)p.block_size, p.lengths);
+}
+
+// Upper bound of the HUF2 file from the plan, to preallocate the output.
+static std::uint64_t planned_size(std::span<const uint8_t> data, const Plan& p,
+                                  const HuffContext::Scratch& s) {
+    std::uint64_t n = HUF2_HEADER_SIZE + HUF2_BLOCK_HEADER_SIZE + HUF2_FOOTER_SIZE;
+    for (std::size_t i = 0; i < s.stored.size(); ++i) {
+        const std::size_t raw = chunk_at(data, p, i).size();
+        const int streams = block_streams(p.streams, raw);
+        n += HUF2_BLOCK_HEADER_SIZE + HUF2_INDEX_ENTRY_SIZE;
+        n += s.stored[i] || p.shared ? raw : (coded_bits(s.chunk_freqs[i], p.lengths) + 7) / 8
+                                             + stream_jump_table_size(streams) + std::size_t(streams);
     }
+    return n;
+}
 
-    const std::size_t chunk_size = (std::size_t)1 << 20; // 1 MiB chunks
-    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
-    // For demo determinism you can force: int threads = 4;
+} // namespace
 
-    std::vector<MemBitWriter> chunks;
-    encode_chunks_parallel(data, table, chunk_size, threads, chunks);
+HuffContext::HuffContext(int t)
+    : threads(t > 0 ? t : cpu_topology().cpus),
+      scratch(std::make_unique<Scratch>()) {}
 
-    BitWriter bw(fo);
-    for (const auto& mbw : chunks) {
-        mbw.replay_into(bw);   // writes only valid bits of each buffer (no per-chunk padding)
-    }
-    bw.flush();
+HuffContext::~HuffContext() = default;
 
-    std::fclose(fo);
-    free_tree(root);
+std::size_t compress_bound(std::size_t src_len) {
+    // stored fallback: no block body outgrows its raw bytes; plan_work never
+    // cuts blocks smaller than SCHED_MIN_BLOCK
+    const std::size_t nblocks = (src_len + SCHED_MIN_BLOCK - 1) / SCHED_MIN_BLOCK;
+    return src_len + HUF2_HEADER_SIZE + HUF2_BLOCK_HEADER_SIZE + HUF2_FOOTER_SIZE
+         + nblocks * (HUF2_BLOCK_HEADER_SIZE + HUF2_INDEX_ENTRY_SIZE);
+}
+
+int compress_buffer(HuffContext& ctx, const void* src, std::size_t src_len,
+                    void* dst, std::size_t dst_cap, std::size_t& out_len,
+                    const CompressOptions& opt) {
+    out_len = 0;
+    if (opt.format == 1 || opt.stream) return 4;   // buffers are always whole-input HUF2
+    if (opt.table && !shared_table_usable(*opt.table)) return 4;
+
+    HuffContext::Scratch& s = *ctx.scratch;
+    std::span<const uint8_t> data(static_cast<const uint8_t*>(src), src_len);
+    const WorkPlan w = plan_work(src_len, ctx.threads);
+    Plan p;
+    plan_chunks(data, opt, w.threads, w.block_size, s, p);
+
+    // --- encode every chunk, then lay the blocks out in dst ---
+    const std::size_t nchunks = s.chunk_crcs.size();
+    if (s.chunks.size() < nchunks) s.chunks.resize(nchunks);
+    if (nchunks == 1) encode_planned(data, p, s, 0, s.chunks[0]);   // small input: no pool round trip
+    else parallel_for(nchunks, w.threads, [&](std::size_t i) { encode_planned(data, p, s, i, s.chunks[i]); });
+
+    Sink sink;
+    sink.buf = static_cast<uint8_t*>(dst);
+    sink.cap = dst_cap;
+    Huf2Writer out(sink, s.offsets, s.raw_lens);
+    write_plan_header(out, p);
+    for (std::size_t i = 0; i < nchunks; ++i) write_planned(out, data, p, s, i, s.chunks[i]);
+    out.finish();
+
+    if (sink.overflow) return HUFF_ERR_DST_TOO_SMALL;
+    out_len = sink.len;
     return 0;
 }
+
+int compress_file(const char* in_path, const char* out_path, const CompressOptions& opt) {
+    int threads = opt.threads > 0 ? opt.threads : cpu_topology().cpus;
+    if (opt.table && (opt.format == 1 || !shared_table_usable(*opt.table))) return 4;   // HUFD is HUF2 only
+
+    // --- open input ---
+    std::FILE* fi = open_input(in_path);
+    if (!fi) {
+        // std::perror("compress fopen input");
+        return 1;
+    }
+
+    // Whole input: mapped in place when possible, else read into memory (use
+    // opt.stream for inputs larger than memory). Under a memory limit an input
+    // that cannot be mapped is streamed instead.
+    MappedInput mapped;
+    const bool stream = opt.stream || is_std_path(in_path) ||
+                        (!mapped.load(in_path) && memory_limit() && opt.format != 1);
+    if (stream) {
+        if (opt.format == 1) { close_file(fi); return 4; } // HUF1 needs the whole input up front
+        // regular output file: blocks written at their offsets, else one FILE
+        PositionalOutput po;
+        Sink fo;
+        if (!po.open(out_path, 0)) {
+            fo.f = open_output(out_path);
+            if (!fo.f) { close_file(fi); return 2; }
+        }
+        std::vector<std::uint64_t> offsets;
+        std::vector<std::uint32_t> raw_lens;
+        // raw block + coded output per slot
+        const WorkPlan w = plan_stream(HUF2_BLOCK_SIZE, threads, 2);
+        Huf2Writer out = fo.f ? Huf2Writer(fo, offsets, raw_lens)
+                              : Huf2Writer(po, w.slots > 1, offsets, raw_lens);
+        compress_stream(fi, out, w, opt.max_code_len, opt.streams, opt.table);
+        bool failed = std::ferror(fi) != 0;
+        close_file(fi);
+        if (fo.f) failed = std::ferror(fo.f) || close_file(fo.f) != 0 || failed;
+        else      failed = po.close(out.pos) != 0 || failed;
+        return failed ? 3 : 0;
+    }
+
+    std::vector<uint8_t> buffered;
+    std::span<const uint8_t> data;
+    if (mapped.is_open()) {
+        data = std::span<const uint8_t>(mapped.data, mapped.size);
+    } else {
+        if (is_seekable(fi) && seek_to(fi, 0, SEEK_END)) {
+            std::int64_t end = tell_pos(fi);
+            if (end > 0) buffered.reserve((std::size_t)end);
+            seek_to(fi, 0, SEEK_SET);
+        }
+        StageTimer st(STAGE_READ, 0);
+        uint8_t buf[1<<16];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof buf, fi)) > 0) buffered.insert(buffered.end(), buf, buf + n);
+        st.bytes = buffered.size();
+        data = buffered;
+    }
+    close_file(fi);
+
+    // thread count and block size from the input size and the caches
+    const WorkPlan w = plan_work(data.size(), threads);
+    threads = w.threads;
+    HuffContext::Scratch s;
+    Plan p;
+    if (memory_limit() && mapped.map) {
+        p.input = &mapped;
+        p.window = w.slots;
+    }
+    plan_chunks(data, opt, threads, w.block_size, s, p);
+
+    // --- open output: HUF2 to a regular file goes out positionally ---
+    PositionalOutput po;
+    Sink fo;
+    if (opt.format == 1 || !po.open(out_path, planned_size(data, p, s))) {
+        fo.f = open_output(out_path);
+        if (!fo.f) {
+            // std::perror("compress fopen output");
+            return 2;
+        }
+    }
+
+    // --- encode on the pool, write each chunk as soon as it and its predecessors are done ---
+    struct Chunk {
+        std::size_t idx = 0;
+        bool used = false;
+        MemBitWriter enc;
+        BlockWrite w;
+    };
+    std::vector<Chunk> ring(w.slots);
+    std::size_t next = 0;
+    auto next_chunk = [&](Chunk& c) {
+        c.w.wait();
+        if (c.used && p.input) p.input->release(c.idx * p.block_size, p.block_size);   // written out
+        c.used = true;
+        if (next == s.chunk_crcs.size()) return false;
+        c.idx = next++;
+        return true;
+    };
+    auto encode = [&](Chunk& c) { encode_planned(data, p, s, c.idx, c.enc); };
+
+    if (opt.format == 1) {
+        // one stitched bitstream: the pad bits follow from the histogram up front
+        write_huf1_header(fo, p.lengths, data.size(), coded_bits(p.freq, p.lengths), p.crc);
+        BitWriter bw(fo.f);
+        run_pipeline(ring, next_chunk, encode, [&](Chunk& c) {
+            StageTimer st(STAGE_STITCH, c.enc.bytes.size());
+            c.enc.replay_into(bw);   // writes only valid bits of each buffer (no per-chunk padding)
+        });
+        bw.flush();
+    } else {
+        Huf2Writer out = fo.f ? Huf2Writer(fo, s.offsets, s.raw_lens)
+                              : Huf2Writer(po, ring.size() > 1, s.offsets, s.raw_lens);
+        write_plan_header(out, p);
+        run_pipeline(ring, next_chunk, encode, [&](Chunk& c) {
+            write_planned(out, data, p, s, c.idx, c.enc, &c.w);
+        });
+        for (Chunk& c : ring) c.w.wait();
+        out.finish();
+        if (!fo.f) return po.close(out.pos) != 0 ? 3 : 0;
+    }
+
+    bool failed = std::ferror(fo.f) != 0;
+    if (close_file(fo.f) != 0) failed = true;
+    return failed ? 3 : 0;
+}
@@ -1,15 +1,225 @@
 #include "crc32.hpp"
 #include <cstddef>  
+#include <array>
 
-// Poly 0xEDB88320 (IEEE)
-std::uint32_t crc32_update(std::uint32_t crc, const unsigned char* data, std::size_t len) {
-    for (std::size_t i = 0; i < len; ++i) {
-        crc ^= data[i];
-        for (int k = 0; k < 8; ++k) {
-            std::uint32_t mask = -(crc & 1u);
-            crc = (crc >> 1) ^ (0xEDB88320u & mask);
-        }
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define HUFF_CRC_PCLMUL 1
+#endif
+
+namespace {
+
+constexpr std::uint32_t POLY = 0xEDB88320u; // IEEE, reflected
+
+using Tables = std::array<std::array<std::uint32_t,256>,16>;
+
+constexpr Tables make_tables() {
+    Tables t{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1u) ? (c >> 1) ^ POLY : (c >> 1);
+        t[0][i] = c;
+    }
+    for (std::uint32_t i = 0; i < 256; ++i)
+        for (int s = 1; s < 16; ++s)
+            t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFFu];
+    return t;
+}
+
+constexpr Tables T = make_tables();
+
+inline std::uint32_t load32(const unsigned char* p) {
+    return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) |
+           (std::uint32_t(p[2]) << 16) | (std::uint32_t(p[3]) << 24);
+}
+
+// Portable kernel: 16 bytes per step through 16 lookup tables.
+std::uint32_t crc32_slice16(std::uint32_t crc, const unsigned char* p, std::size_t len) {
+    while (len >= 16) {
+        std::uint32_t a = crc ^ load32(p);
+        std::uint32_t b = load32(p + 4);
+        std::uint32_t c = load32(p + 8);
+        std::uint32_t d = load32(p + 12);
+        crc = T[15][a & 0xFF] ^ T[14][(a >> 8) & 0xFF] ^ T[13][(a >> 16) & 0xFF] ^ T[12][a >> 24]
+            ^ T[11][b & 0xFF] ^ T[10][(b >> 8) & 0xFF] ^ T[9][(b >> 16) & 0xFF]  ^ T[8][b >> 24]
+            ^ T[7][c & 0xFF]  ^ T[6][(c >> 8) & 0xFF]  ^ T[5][(c >> 16) & 0xFF]  ^ T[4][c >> 24]
+            ^ T[3][d & 0xFF]  ^ T[2][(d >> 8) & 0xFF]  ^ T[1][(d >> 16) & 0xFF]  ^ T[0][d >> 24];
+        p += 16;
+        len -= 16;
     }
+    while (len--) crc = (crc >> 8) ^ T[0][(crc ^ *p++) & 0xFF];
     return crc;
 }
 
+#ifdef HUFF_CRC_PCLMUL
+// Carry-less multiply folding (Gopal et al., "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ"), four 128-bit lanes at a time.
+// Needs len >= 64 and a multiple of 16.
+__attribute__((target("pclmul,sse4.1")))
+std::uint32_t crc32_fold(std::uint32_t crc, const unsigned char* buf, std::size_t len) {
+    alignas(16) static const std::uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const std::uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const std::uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const std::uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+    buf += 64;
+    len -= 64;
+
+    // fold 4 x 128 bits per step
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    // fold the four lanes into one
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining 16-byte blocks
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (std::uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+std::uint32_t crc32_pclmul(std::uint32_t crc, const unsigned char* p, std::size_t len) {
+    if (len >= 64) {
+        std::size_t bulk = len & ~std::size_t(15);
+        crc = crc32_fold(crc, p, bulk);
+        p += bulk;
+        len -= bulk;
+    }
+    return crc32_slice16(crc, p, len);
+}
+#endif
+
+using Kernel = std::uint32_t (*)(std::uint32_t, const unsigned char*, std::size_t);
+
+struct Dispatch {
+    Kernel fn = crc32_slice16;
+    const char* name = "slice16";
+    Dispatch() {
+#ifdef HUFF_CRC_PCLMUL
+        if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+            fn = crc32_pclmul;
+            name = "pclmul";
+        }
+#endif
+    }
+};
+
+const Dispatch& dispatch() {
+    static const Dispatch d;
+    return d;
+}
+
+// a * b modulo the CRC polynomial (bit-reflected)
+std::uint32_t multmodp(std::uint32_t a, std::uint32_t b) {
+    std::uint32_t m = 1u << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = (b & 1u) ? (b >> 1) ^ POLY : (b >> 1);
+    }
+    return p;
+}
+
+// x^(2^k) mod p for k = 0..31
+constexpr std::array<std::uint32_t,32> make_x2n() {
+    std::array<std::uint32_t,32> t{};
+    std::uint32_t p = 1u << 30;   // x^1
+    t[0] = p;
+    for (int k = 1; k < 32; ++k) {
+        // square p (constexpr copy of multmodp)
+        std::uint32_t a = p, b = p, m = 1u << 31, r = 0;
+        for (;;) {
+            if (a & m) {
+                r ^= b;
+                if ((a & (m - 1)) == 0) break;
+            }
+            m >>= 1;
+            b = (b & 1u) ? (b >> 1) ^ POLY : (b >> 1);
+        }
+        t[k] = p = r;
+    }
+    return t;
+}
+
+constexpr std::array<std::uint32_t,32> X2N = make_x2n();
+
+} // namespace
+
+std::uint32_t crc32_update(std::uint32_t crc, const unsigned char* data, std::size_t len) {
+    return dispatch().fn(crc, data, len);
+}
+
+std::uint32_t crc32_combine(std::uint32_t crc1, std::uint32_t crc2, std::uint64_t len2) {
+    // crc1 * x^(8 * len2) mod p, then add crc2
+    std::uint32_t xn = 1u << 31;   // x^0
+    for (unsigned k = 3; len2; len2 >>= 1, ++k)
+        if (len2 & 1) xn = multmodp(X2N[k & 31], xn);
+    return multmodp(xn, crc1) ^ crc2;
+}
+
+const char* crc32_kernel_name() {
+    return dispatch().name;
+}
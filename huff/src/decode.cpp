@@ -0,0 +1,234 @@
+#include "decode.hpp"
+#include "format.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr std::uint32_t DEC_MASK = (1u << DEC_TABLE_BITS) - 1;
+
+// fast entry helpers
+inline std::uint32_t entry_count(std::uint32_t e) { return (e >> 16) & 3u; }
+inline int entry_len0(std::uint32_t e)  { return int((e >> 18) & 31u); }
+inline int entry_bits(std::uint32_t e)  { return int(e >> 24); }
+
+// MSB-first reader over a memory span; the next bits sit at the top of buf.
+struct SpanReader {
+    const std::uint8_t* src;
+    std::size_t len;
+    std::size_t pos = 0;     // next byte to load
+    std::uint64_t buf = 0;
+    int cnt = 0;             // valid bits in buf
+    std::uint64_t pad = 0;   // zero bits appended past the end of src
+
+    void refill() {
+        if (len - pos >= 8) {
+            std::uint64_t w;
+            std::memcpy(&w, src + pos, 8);
+            w = __builtin_bswap64(w);
+            buf |= w >> cnt;
+            pos += std::size_t((63 - cnt) >> 3);
+            cnt |= 56;
+        } else {
+            while (cnt <= 56) {
+                std::uint64_t b = 0;
+                if (pos < len) b = src[pos++];
+                else pad += 8;
+                buf |= b << (56 - cnt);
+                cnt += 8;
+            }
+        }
+    }
+    void consume(int n) { buf <<= n; cnt -= n; }
+    std::uint64_t bit_pos() const { return std::uint64_t(pos) * 8 + pad - std::uint64_t(cnt); }
+};
+
+// Canonical search for codes longer than the primary table; needs >= max_len bits in r.
+inline bool decode_long(const DecodeTable& t, SpanReader& r, std::uint8_t& sym) {
+    const std::uint32_t w = std::uint32_t(r.buf >> 32);
+    for (int l = DEC_TABLE_BITS + 1; l <= t.max_len; ++l) {
+        std::uint32_t d = (w >> (32 - l)) - t.first[l];
+        if (d < t.count[l]) {
+            sym = t.syms[t.offset[l] + d];
+            r.consume(l);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Up to four primary-table probes; a long code ends the batch early.
+// Needs a fresh refill and room for 8 more symbols at dst[i].
+inline bool decode_batch(const DecodeTable& t, SpanReader& r, std::uint8_t* dst, std::size_t& i) {
+    // four probes of at most DEC_TABLE_BITS bits fit in the 56 refilled bits
+    for (int k = 0; k < 4; ++k) {
+        std::uint32_t e = t.fast[r.buf >> (64 - DEC_TABLE_BITS)];
+        if (!entry_count(e)) {
+            if (r.cnt < DEC_MAX_LEN) r.refill();
+            if (!decode_long(t, r, dst[i])) return false;
+            ++i;
+            return true;
+        }
+        dst[i] = std::uint8_t(e);
+        dst[i + 1] = std::uint8_t(e >> 8);
+        i += entry_count(e);
+        r.consume(entry_bits(e));
+    }
+    return true;
+}
+
+} // namespace
+
+bool build_decode_table(const std::array<std::uint8_t,256>& lens, DecodeTable& t) {
+    t = DecodeTable{};
+
+    for (int s = 0; s < 256; ++s) {
+        int l = lens[s];
+        if (l == 0) continue;
+        if (l > DEC_MAX_LEN) return false;
+        t.count[l]++;
+        if (l > t.max_len) t.max_len = l;
+    }
+
+    // Kraft: reject over-subscribed length sets (incomplete is fine, e.g. one symbol)
+    std::uint64_t kraft = 0;
+    for (int l = 1; l <= t.max_len; ++l) kraft += std::uint64_t(t.count[l]) << (DEC_MAX_LEN - l);
+    if (kraft > (std::uint64_t(1) << DEC_MAX_LEN)) return false;
+
+    // symbols sorted by (len, sym), and first canonical code per length
+    std::uint16_t next[DEC_MAX_LEN + 1] = {};
+    std::uint32_t code = 0;
+    for (int l = 1; l <= DEC_MAX_LEN; ++l) {
+        code = (code + t.count[l - 1]) << 1;   // count[0] == 0, so first[1] == 0
+        t.first[l] = code;
+        t.offset[l] = std::uint16_t(t.nsyms);
+        next[l] = std::uint16_t(t.nsyms);
+        t.nsyms += int(t.count[l]);
+    }
+    for (int s = 0; s < 256; ++s)
+        if (lens[s]) t.syms[next[lens[s]]++] = std::uint8_t(s);
+
+    // single-symbol entries for every code that fits the primary table
+    std::array<std::uint32_t, 1u << DEC_TABLE_BITS> single{};
+    for (int l = 1; l <= DEC_TABLE_BITS && l <= t.max_len; ++l) {
+        for (std::uint32_t k = 0; k < t.count[l]; ++k) {
+            std::uint32_t c = t.first[l] + k;
+            std::uint32_t sym = t.syms[t.offset[l] + k];
+            std::uint32_t e = sym | (1u << 16) | (std::uint32_t(l) << 18) | (std::uint32_t(l) << 24);
+            std::uint32_t lo = c << (DEC_TABLE_BITS - l), hi = (c + 1) << (DEC_TABLE_BITS - l);
+            for (std::uint32_t i = lo; i < hi; ++i) single[i] = e;
+        }
+    }
+
+    // pair up: if the bits left after the first code fully determine a second one,
+    // emit both from the same probe
+    for (std::uint32_t i = 0; i <= DEC_MASK; ++i) {
+        std::uint32_t e = single[i];
+        t.fast[i] = e;
+        if (!e) continue;
+        int l1 = entry_bits(e);
+        if (l1 >= DEC_TABLE_BITS) continue;
+        std::uint32_t e2 = single[(i << l1) & DEC_MASK];
+        if (!e2 || entry_bits(e2) > DEC_TABLE_BITS - l1) continue;
+        t.fast[i] = (e & 0xFFu) | ((e2 & 0xFFu) << 8) | (2u << 16)
+                  | (std::uint32_t(l1) << 18) | (std::uint32_t(l1 + entry_bits(e2)) << 24);
+    }
+    return true;
+}
+
+std::size_t decode_symbols(const DecodeTable& t,
+                           const std::uint8_t* src, std::size_t src_len, bool final,
+                           std::uint64_t& bit_pos,
+                           std::uint8_t* dst, std::size_t n, int& err)
+{
+    err = 0;
+    if (n == 0) return 0;
+    if (bit_pos > std::uint64_t(src_len) * 8) { err = 6; return 0; }
+
+    SpanReader r{src, src_len, std::size_t(bit_pos >> 3)};
+    r.refill();
+    r.consume(int(bit_pos & 7));
+
+    const std::uint32_t* fast = t.fast.data();
+    std::size_t i = 0;
+    while (i < n) {
+        if (!final && src_len - r.pos < DEC_LOOKAHEAD) break;
+        if (r.pad > std::uint64_t(r.cnt)) { err = 6; break; }   // read past the end
+        r.refill();
+
+        if (n - i >= 8) {
+            if (!decode_batch(t, r, dst, i)) { err = 7; break; }
+        } else {
+            std::uint32_t e = fast[r.buf >> (64 - DEC_TABLE_BITS)];
+            if (entry_count(e)) {
+                dst[i++] = std::uint8_t(e);
+                r.consume(entry_len0(e));
+            } else if (decode_long(t, r, dst[i])) {
+                ++i;
+            } else {
+                err = 7;
+                break;
+            }
+        }
+    }
+
+    bit_pos = r.bit_pos();
+    if (bit_pos > std::uint64_t(src_len) * 8) err = 6;
+    return i;
+}
+
+int decode_multi(const DecodeTable& t,
+                 const std::uint8_t* src, std::size_t src_len,
+                 std::uint8_t* dst, std::size_t dst_len)
+{
+    // --- jump table ---
+    if (src_len < 1) return 11;
+    const int ns = src[0];
+    if (ns < 2 || ns > HUF2_MAX_STREAMS || src_len < stream_jump_table_size(ns)) return 11;
+    const std::uint8_t* in[HUF2_MAX_STREAMS];
+    std::size_t in_len[HUF2_MAX_STREAMS];
+    std::uint8_t* out[HUF2_MAX_STREAMS];
+    std::size_t out_len[HUF2_MAX_STREAMS], done[HUF2_MAX_STREAMS] = {};
+
+    std::size_t at = stream_jump_table_size(ns);
+    const std::size_t seg = stream_segment(dst_len, ns);
+    for (int k = 0; k < ns; ++k) {
+        std::size_t len = (k + 1 < ns) ? load_u32_le(src + 1 + 4 * k) : src_len - at;
+        if (len > src_len - at) return 11;
+        in[k] = src + at;
+        in_len[k] = len;
+        at += len;
+        const std::size_t o = std::min(dst_len, seg * std::size_t(k));
+        out[k] = dst + o;
+        out_len[k] = std::min(seg, dst_len - o);
+    }
+
+    // --- lockstep: one batch from every stream per round while all have room ---
+    SpanReader r[HUF2_MAX_STREAMS] = {};
+    for (int k = 0; k < ns; ++k) {
+        r[k] = SpanReader{in[k], in_len[k]};
+        r[k].refill();
+    }
+
+    for (;;) {
+        bool room = true;
+        for (int k = 0; k < ns; ++k)
+            room &= out_len[k] - done[k] >= 8 && in_len[k] - r[k].pos >= 8;
+        if (!room) break;
+        for (int k = 0; k < ns; ++k) {
+            r[k].refill();
+            if (!decode_batch(t, r[k], out[k], done[k])) return 7;
+        }
+    }
+
+    // --- each stream finishes on its own ---
+    for (int k = 0; k < ns; ++k) {
+        std::uint64_t bit = r[k].bit_pos();
+        int err = 0;
+        done[k] += decode_symbols(t, in[k], in_len[k], true, bit,
+                                  out[k] + done[k], out_len[k] - done[k], err);
+        if (err) return err;
+        if (done[k] != out_len[k]) return 6;
+    }
+    return 0;
+}
@@ -1,6 +1,13 @@
 #include "huff.hpp"
 #include "bitio.hpp"
 #include "crc32.hpp"   // ✅ include CRC
+#include "decode.hpp"
+#include "format.hpp"
+#include "threads.hpp"   // decode_blocks_parallel
+#include "io.hpp"
+#include "context.hpp"
+#include "stats.hpp"
+#include "sched.hpp"
 
 #include <cstdint>
 #include <cstdio>
@@ -12,174 +19,651 @@
 
 namespace {
 
-static const uint8_t MAGIC[4] = {'H','U','F','1'};
-
 inline bool read_exact(std::FILE* f, void* dst, size_t n) {
     return std::fread(dst, 1, n, f) == n;
 }
 
-inline std::uint64_t read_u64_le(std::FILE* f) {
-    std::uint64_t x = 0;
-    for (int i = 0; i < 8; ++i) {
-        int c = std::fgetc(f);
-        if (c == EOF) return 0; // will fail later
-        x |= (static_cast<std::uint64_t>(c) << (8 * i));
-    }
-    return x;
+// Header bytes at off: from the mapping when there is one, else straight from
+// fi, which must already be positioned there (works for pipes).
+static bool read_header(std::FILE* fi, const MappedInput* map, std::size_t off, void* dst, std::size_t n) {
+    if (!map) return read_exact(fi, dst, n);
+    if (off > map->size || n > map->size - off) return false;
+    std::memcpy(dst, map->data + off, n);
+    return true;
 }
 
-inline std::uint32_t read_u32_le(std::FILE* f) {
-    std::uint32_t x = 0;
-    for (int i = 0; i < 4; ++i) {
-        int c = std::fgetc(f);
-        if (c == EOF) return 0;
-        x |= (static_cast<std::uint32_t>(c) << (8 * i));
-    }
-    return x;
+// Output goes to out_path, or into the caller buffer out already wraps (out_path null).
+static int open_sink(OutputSink& out, const char* out_path, std::uint64_t size) {
+    if (!out_path) return size == OutputSink::UNKNOWN_SIZE || size <= out.size ? 0 : HUFF_ERR_DST_TOO_SMALL;
+    return out.open(out_path, size) ? 0 : 4;
 }
 
-struct DecNode {
-    DecNode* child[2] = {nullptr, nullptr};
-    int sym = -1;
-};
-
-void free_tree(DecNode* n) {
-    if (!n) return;
-    free_tree(n->child[0]);
-    free_tree(n->child[1]);
-    delete n;
-}
+constexpr std::size_t IN_BUF  = std::size_t(1) << 20;
+constexpr std::size_t OUT_BUF = std::size_t(1) << 20;
 
-static void build_decode_tree(const std::array<uint8_t,256>& lens, DecNode*& root) {
-    struct L { uint8_t len; int sym; };
-    std::vector<L> items; items.reserve(256);
-    for (int s=0; s<256; ++s) if (lens[s] > 0) items.push_back({lens[s], s});
+// ---- HUF1: one bitstream, decoded sequentially ----
+static int decompress_huf1(std::FILE* fi, const MappedInput* map, const char* out_path,
+                           OutputSink& out, HuffContext::Scratch& s) {
+    // --- Read header: orig_size u64 | lengths[256] | pad_bits u8 | crc32 u32 ---
+    uint8_t hdr[HUF1_HEADER_SIZE - 4];
+    if (!read_header(fi, map, 4, hdr, sizeof hdr)) return 3; // header truncated
+    std::uint64_t orig_size = load_u64_le(hdr);
+    std::array<uint8_t,256> lengths{};
+    std::memcpy(lengths.data(), hdr + 8, 256);
 
-    std::sort(items.begin(), items.end(), [](const L& a, const L& b){
-        if (a.len != b.len) return a.len < b.len;
-        return a.sym < b.sym;
-    });
+    int pad_bits = hdr[8 + 256];
+    if (pad_bits > 7) {
+        return 9; // bad pad bits
+    }
+    std::uint32_t crc_expected = load_u32_le(hdr + 8 + 256 + 1);
 
-    root = new DecNode();
-    if (items.empty()) return;
+    // --- Open output (preallocated + mapped when possible) ---
+    if (int rc = open_sink(out, out_path, orig_size)) return rc;
+    if (orig_size == 0) {
+        return out.close() == 0 ? 0 : 8;
+    }
 
-    uint32_t code = 0;
-    int prev_len = items.front().len;
+    // --- Build decode tables ---
+    DecodeTable& table = s.table;
+    if (!build_decode_table(lengths, table)) { out.close(); return 5; }
 
-    // Insert first code (0 of length prev_len)
-    {
-        DecNode* cur = root;
-        for (int i = prev_len - 1; i >= 0; --i) {
-            int bit = (code >> i) & 1;
-            if (!cur->child[bit]) cur->child[bit] = new DecNode();
-            cur = cur->child[bit];
-        }
-        cur->sym = items.front().sym;
+    // --- Decode ---
+    // A mapped input is decoded in place; otherwise the payload is fed through a
+    // sliding input window. Output is produced a block at a time.
+    std::vector<uint8_t> in;
+    const uint8_t* src;
+    std::size_t have;
+    bool eof;
+    if (map) {
+        src = map->data + HUF1_HEADER_SIZE;
+        have = map->size - HUF1_HEADER_SIZE;
+        eof = true;
+    } else {
+        in.resize(IN_BUF);
+        have = std::fread(in.data(), 1, in.size(), fi);
+        eof = have < in.size();
+        src = in.data();
     }
+    std::uint64_t bit = 0;
+    std::uint64_t written = 0;
+    std::uint32_t crc_running = 0xFFFFFFFFu;
+    std::size_t released = 0;   // mapped input dropped so far (memory limit)
 
-    for (size_t i = 1; i < items.size(); ++i) {
-        const auto& it = items[i];
-        // next code value
-        code += 1;
-        if (it.len > prev_len) {
-            code <<= (it.len - prev_len);
-            prev_len = it.len;
+    while (written < orig_size) {
+        std::size_t want = (std::size_t)std::min<std::uint64_t>(OUT_BUF, orig_size - written);
+        uint8_t* dst = out.reserve(want);
+        int err = 0;
+        std::size_t got;
+        {
+            StageTimer st(STAGE_DECODE, want);
+            got = decode_symbols(table, src, have, eof, bit, dst, want, err);
         }
-        DecNode* cur = root;
-        for (int b = it.len - 1; b >= 0; --b) {
-            int bit = (code >> b) & 1;
-            if (!cur->child[bit]) cur->child[bit] = new DecNode();
-            cur = cur->child[bit];
+        if (err) { // 6: unexpected EOF, 7: invalid stream
+            s.win.bad.bad_offset = written;   // somewhere in this stretch of output
+            s.win.bad.bad_length = want;
+            out.close();
+            return err;
         }
-        cur->sym = it.sym;
+        if (got) {
+            {
+                StageTimer st(STAGE_CRC, got);
+                crc_running = crc32_update(crc_running, dst, got);
+            }
+            if (!out.commit(got)) {
+                out.close();
+                return 8;
+            }
+            written += got;
+        }
+        if (map && memory_limit()) {   // the input behind the decoder is done with
+            const std::size_t done = HUF1_HEADER_SIZE + std::size_t(bit >> 3);
+            map->release(released, done - released);
+            released = done;
+        }
+        if (got < want && !eof) {
+            // slide the unread tail to the front and top up
+            std::size_t used = std::size_t(bit >> 3);
+            std::memmove(in.data(), in.data() + used, have - used);
+            have -= used;
+            bit -= std::uint64_t(used) * 8;
+            StageTimer st(STAGE_READ, in.size() - have);
+            std::size_t r = std::fread(in.data() + have, 1, in.size() - have, fi);
+            have += r;
+            if (have < in.size()) eof = true;
+        }
+    }
+
+    if (out.close() != 0) return 8;
+    crc_running ^= 0xFFFFFFFFu;
+    if (crc_running != crc_expected) { // CRC mismatch: one checksum, no way to narrow it down
+        s.win.bad.bad_length = orig_size;
+        return 10;
     }
+    (void)pad_bits; // informational in this format; stopping by orig_size is sufficient
+    return 0;
 }
 
+// ---- HUF2: blocks are decoded a window at a time on all cores ----
 
 } // namespace
 
-int decompress_file(const char* in_path, const char* out_path, int /*verify*/) {
-    std::FILE* fi = std::fopen(in_path, "rb");
-    if (!fi) return 1;
+// BlockWindow (context.hpp) holds one window of raw blocks and the state carried across windows.
+int BlockWindow::run(const std::uint32_t* expect_raw) {
+    const std::size_t n = starts.size();
+    jobs.assign(n, DecodeJob{});
+    block_crc.assign(n, 0);
 
-    // --- Read header ---
-    uint8_t magic[4];
-    if (!read_exact(fi, magic, 4) || std::memcmp(magic, MAGIC, 4) != 0) {
-        std::fclose(fi);
-        return 2; // bad magic
+    // records the first failing block and the original bytes it covers
+    std::uint64_t raw_at = written;
+    auto fail = [&](std::size_t i, std::uint64_t len, int rc) {
+        bad.bad_block = (std::int64_t)(blocks + i);
+        bad.bad_offset = raw_at;
+        bad.bad_length = len;
+        return rc;
+    };
+
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const uint8_t* p = src + starts[i];
+        const std::size_t avail = (i + 1 < n ? starts[i + 1] : src_len) - starts[i];
+        if (avail < HUF2_BLOCK_HEADER_SIZE) return fail(i, expect_raw ? expect_raw[i] : 0, 11);
+        const std::uint32_t raw_len = load_u32_le(p + 1);
+        std::uint32_t comp_len = load_u32_le(p + 5);
+        if (p[0] > BLOCK_HUFF_TABLE_MULTI ||
+            comp_len > avail - HUF2_BLOCK_HEADER_SIZE ||
+            (p[0] == BLOCK_STORED && comp_len != raw_len) ||
+            (expect_raw && raw_len != expect_raw[i]))
+            return fail(i, expect_raw ? expect_raw[i] : 0, 11); // block header disagrees with the index
+
+        DecodeJob& job = jobs[i];
+        const uint8_t* body = p + HUF2_BLOCK_HEADER_SIZE;
+        if (p[0] == BLOCK_HUFF_TABLE || p[0] == BLOCK_HUFF_TABLE_MULTI) {
+            if (comp_len < 256) return fail(i, raw_len, 11); // no room for the lengths
+            job.lengths = body;
+            body += 256;
+            comp_len -= 256;
+        }
+        raw_at += raw_len;
+        job.stored = p[0] == BLOCK_STORED;
+        job.multi = p[0] == BLOCK_HUFF_MULTI || p[0] == BLOCK_HUFF_TABLE_MULTI;
+        job.src = body;
+        job.src_len = comp_len;
+        job.dst_len = raw_len;
+        block_crc[i] = load_u32_le(p + 9);
+        total += raw_len;
     }
-    std::uint64_t orig_size = read_u64_le(fi);
 
+    uint8_t* dst = out->reserve(total);
+    if (!dst) return 11; // more output than the footer announced
+    std::size_t at = 0;
+    for (auto& job : jobs) {
+        // nothing keeps discarded output: stored blocks are checksummed where they lie
+        if (out->discard && job.stored) { job.dst = const_cast<uint8_t*>(job.src); continue; }
+        job.dst = dst + at;
+        at += job.dst_len;
+    }
+
+    decode_blocks_parallel(*table, jobs, threads);
+
+    raw_at = written;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (jobs[i].err) return fail(i, jobs[i].dst_len, jobs[i].err);
+        if (jobs[i].crc != block_crc[i]) return fail(i, jobs[i].dst_len, 10);
+        crc = crc32_combine(crc, jobs[i].crc, jobs[i].dst_len);
+        raw_at += jobs[i].dst_len;
+    }
+    if (!out->commit(total)) return 8;
+    written += total;
+    blocks += n;
+    return 0;
+}
+
+namespace {
+
+// HUF2 / HUFD header after the magic (fi positioned there when not mapped):
+// block size, header size and the table for blocks without their own, built
+// from the header lengths into s.table or taken from the registered shared table.
+static int read_huf2_header(std::FILE* fi, const MappedInput* map, bool shared, HuffContext::Scratch& s,
+                            std::uint32_t& block_size, std::uint64_t& header_size,
+                            const DecodeTable*& table) {
+    if (shared) {
+        uint8_t hdr[HUFD_HEADER_SIZE - 4];
+        if (!read_header(fi, map, 4, hdr, sizeof hdr)) return 3;
+        block_size = load_u32_le(hdr);
+        if (block_size == 0 || block_size > HUF2_BLOCK_SIZE) return 11; // nothing plans or indexes with it
+        header_size = HUFD_HEADER_SIZE;
+        table = find_shared_table(load_u32_le(hdr + 4));
+        return table ? 0 : HUFF_ERR_NO_TABLE;
+    }
+    uint8_t hdr[HUF2_HEADER_SIZE - 4];
+    if (!read_header(fi, map, 4, hdr, sizeof hdr)) return 3;
+    block_size = load_u32_le(hdr);
+    if (block_size == 0 || block_size > HUF2_BLOCK_SIZE) return 11;
+    header_size = HUF2_HEADER_SIZE;
     std::array<uint8_t,256> lengths{};
-    if (!read_exact(fi, lengths.data(), 256)) {
-        std::fclose(fi);
-        return 3; // header truncated
+    std::memcpy(lengths.data(), hdr + 4, 256);
+
+    // all-zero lengths: every block carries its own
+    if (!build_decode_table(lengths, s.table)) return 5;
+    table = &s.table;
+    return 0;
+}
+
+// Seekable input: footer -> index -> windows of blocks, taken straight from the
+// mapping when there is one, else read with one fread each.
+static int decode_huf2_indexed(std::FILE* fi, const MappedInput* map, std::uint32_t block_size,
+                               std::uint64_t header_size,
+                               OutputSink& out, const char* out_path, HuffContext::Scratch& s,
+                               std::uint64_t& orig_size, std::uint32_t& crc_expected) {
+    BlockWindow& win = s.win;
+
+    // --- Footer ---
+    uint8_t ft[HUF2_FOOTER_SIZE];
+    std::uint64_t file_size;
+    if (map) {
+        file_size = map->size;
+        if (file_size < HUF2_FOOTER_SIZE) return 11;
+        std::memcpy(ft, map->data + file_size - HUF2_FOOTER_SIZE, sizeof ft);
+    } else {
+        if (!seek_to(fi, -(std::int64_t)HUF2_FOOTER_SIZE, SEEK_END) || !read_exact(fi, ft, sizeof ft))
+            return 11; // missing footer
+        file_size = (std::uint64_t)tell_pos(fi);
     }
+    if (std::memcmp(ft + HUF2_FOOTER_SIZE - 4, HUF2_MAGIC, 4) != 0) return 11;
+    const std::uint32_t nblocks      = load_u32_le(ft + 12);
+    const std::uint64_t index_offset = load_u64_le(ft + 16);
+    orig_size    = load_u64_le(ft);
+    crc_expected = load_u32_le(ft + 8);
+    if (index_offset < header_size + HUF2_BLOCK_HEADER_SIZE ||
+        index_offset + (std::uint64_t)nblocks * HUF2_INDEX_ENTRY_SIZE + HUF2_FOOTER_SIZE != file_size)
+        return 11; // index does not fit
 
-    // NEW: pad_bits + CRC32
-    int pad_bits = std::fgetc(fi);
-    if (pad_bits == EOF || pad_bits < 0 || pad_bits > 7) {
-        std::fclose(fi);
-        return 9; // bad pad bits
+    // blocks end where the END marker starts
+    const std::uint64_t end_marker = index_offset - HUF2_BLOCK_HEADER_SIZE;
+
+    // --- Index ---
+    std::vector<std::uint64_t>& offsets = s.offsets;
+    std::vector<std::uint32_t>& raw_lens = s.raw_lens;
+    offsets.resize(nblocks);
+    raw_lens.resize(nblocks);
+    {
+        const uint8_t* raw;
+        if (map) {
+            raw = map->data + index_offset;
+        } else {
+            win.src_buf.resize((std::size_t)nblocks * HUF2_INDEX_ENTRY_SIZE);
+            if (!seek_to(fi, (std::int64_t)index_offset, SEEK_SET) ||
+                !read_exact(fi, win.src_buf.data(), win.src_buf.size()))
+                return 11;
+            raw = win.src_buf.data();
+        }
+        std::uint64_t prev = header_size, out_off = 0;
+        for (std::uint32_t i = 0; i < nblocks; ++i) {
+            const uint8_t* e = raw + (std::size_t)i * HUF2_INDEX_ENTRY_SIZE;
+            offsets[i] = load_u64_le(e);
+            raw_lens[i] = load_u32_le(e + 8);
+            if (offsets[i] < prev || offsets[i] + HUF2_BLOCK_HEADER_SIZE > end_marker ||
+                raw_lens[i] > block_size)
+                return 11; // offsets must ascend and stay before the END marker
+            prev = offsets[i] + HUF2_BLOCK_HEADER_SIZE;
+            out_off += raw_lens[i];
+        }
+        if (out_off != orig_size) return 11;
     }
-    std::uint32_t crc_expected = read_u32_le(fi);
 
-    // --- Open output ---
-    std::FILE* fo = std::fopen(out_path, "wb");
-    if (!fo) { std::fclose(fi); return 4; }
-    if (orig_size == 0) {
-        std::fclose(fo);
-        std::fclose(fi);
-        return 0;
+    // --- Open output (preallocated + mapped when possible) ---
+    if (int rc = open_sink(out, out_path, orig_size)) return rc;
+
+    // --- Decode a window of blocks at a time: one read, parallel decode, one write ---
+    for (std::size_t a = 0; a < nblocks; ) {
+        const std::size_t b = std::min<std::size_t>(nblocks, a + win.window);
+        const std::uint64_t lo = offsets[a];
+        const std::uint64_t hi = b < nblocks ? offsets[b] : end_marker;
+
+        win.src_len = (std::size_t)(hi - lo);
+        if (map) {
+            win.src = map->data + lo;
+        } else {
+            StageTimer st(STAGE_READ, win.src_len);
+            win.src_buf.resize(win.src_len);
+            if (!seek_to(fi, (std::int64_t)lo, SEEK_SET) || !read_exact(fi, win.src_buf.data(), win.src_len))
+                return 6; // unexpected EOF
+            win.src = win.src_buf.data();
+        }
+        win.starts.clear();
+        for (std::size_t i = a; i < b; ++i) win.starts.push_back((std::size_t)(offsets[i] - lo));
+
+        int rc = win.run(raw_lens.data() + a);
+        if (rc) return rc;
+        if (map && memory_limit()) map->release((std::size_t)lo, win.src_len);
+        a = b;
     }
+    return 0;
+}
 
-    // --- Rebuild decode tree ---
-    DecNode* root = nullptr;
-    build_decode_tree(lengths, root);
-    if (!root) { std::fclose(fo); std::fclose(fi); return 5; }
+// Pipe input: walk block headers up to the END marker, then check index + footer.
+static int decode_huf2_sequential(std::FILE* fi, std::uint32_t block_size, std::uint64_t header_size,
+                                  OutputSink& out, const char* out_path, BlockWindow& win,
+                                  std::uint64_t& orig_size, std::uint32_t& crc_expected) {
+    if (int rc = open_sink(out, out_path, OutputSink::UNKNOWN_SIZE)) return rc;
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::uint32_t> raw_lens;
+    std::uint64_t pos = header_size;
 
-    // --- Decode ---
-    BitReader br(fi);
-    DecNode* cur = root;
-    std::uint64_t written = 0;
-    std::uint32_t crc_running = 0xFFFFFFFFu;
+    for (bool end = false; !end; ) {
+        win.src_buf.clear();
+        win.starts.clear();
+        while (win.starts.size() < win.window) {
+            uint8_t h[HUF2_BLOCK_HEADER_SIZE];
+            if (!read_exact(fi, h, sizeof h)) return 6;
+            if (h[0] == BLOCK_END) { end = true; break; }
+            const std::uint32_t raw_len  = load_u32_le(h + 1);
+            const std::uint32_t comp_len = load_u32_le(h + 5);
+            // codes are at most 32 bits, so a sane body is bounded by its raw length
+            // (plus table, jump table and per-stream padding)
+            if (raw_len > block_size || comp_len > 256 + 64 + 4 * (std::uint64_t)raw_len) return 11;
 
-    while (written < orig_size) {
-        while (cur && cur->sym < 0) {
-            int b = br.read_bit();
-            if (b < 0) { // unexpected EOF
-                free_tree(root);
-                std::fclose(fo); std::fclose(fi);
-                return 6;
-            }
-            cur = cur->child[b];
-            if (!cur) { // invalid stream
-                free_tree(root);
-                std::fclose(fo); std::fclose(fi);
-                return 7;
-            }
+            StageTimer st(STAGE_READ, sizeof h + comp_len);
+            const std::size_t at = win.src_buf.size();
+            win.starts.push_back(at);
+            win.src_buf.resize(at + sizeof h + comp_len);
+            std::memcpy(win.src_buf.data() + at, h, sizeof h);
+            if (!read_exact(fi, win.src_buf.data() + at + sizeof h, comp_len)) return 6;
+
+            offsets.push_back(pos);
+            raw_lens.push_back(raw_len);
+            pos += sizeof h + comp_len;
         }
-        unsigned char outb = static_cast<unsigned char>(cur->sym);
-        if (std::fputc(outb, fo) == EOF) {
-            free_tree(root);
-            std::fclose(fo); std::fclose(fi);
-            return 8;
+        if (!win.starts.empty()) {
+            win.src = win.src_buf.data();
+            win.src_len = win.src_buf.size();
+            int rc = win.run(nullptr);
+            if (rc) return rc;
         }
-        crc_running = crc32_update(crc_running, &outb, 1);
-        written++;
-        cur = root;
     }
 
-    crc_running ^= 0xFFFFFFFFu;
-    if (crc_running != crc_expected) {
-        free_tree(root);
-        std::fclose(fo); std::fclose(fi);
-        return 10; // CRC mismatch
+    // --- index + footer must match the blocks we walked ---
+    std::vector<uint8_t> tail(offsets.size() * HUF2_INDEX_ENTRY_SIZE + HUF2_FOOTER_SIZE);
+    if (!read_exact(fi, tail.data(), tail.size())) return 11;
+    for (std::size_t i = 0; i < offsets.size(); ++i) {
+        const uint8_t* e = tail.data() + i * HUF2_INDEX_ENTRY_SIZE;
+        if (load_u64_le(e) != offsets[i] || load_u32_le(e + 8) != raw_lens[i]) return 11;
     }
+    const uint8_t* ft = tail.data() + offsets.size() * HUF2_INDEX_ENTRY_SIZE;
+    if (std::memcmp(ft + HUF2_FOOTER_SIZE - 4, HUF2_MAGIC, 4) != 0 ||
+        load_u32_le(ft + 12) != offsets.size() ||
+        load_u64_le(ft + 16) != pos + HUF2_BLOCK_HEADER_SIZE)
+        return 11;
+    orig_size    = load_u64_le(ft);
+    crc_expected = load_u32_le(ft + 8);
+    return orig_size == win.written ? 0 : 11;
+}
 
-    free_tree(root);
-    std::fclose(fo);
-    std::fclose(fi);
-    (void)pad_bits; // informational in this format; stopping by orig_size is sufficient
+// shared: HUFD, the file-wide table is a registered shared table
+static int decompress_huf2(std::FILE* fi, const MappedInput* map, const char* out_path,
+                           OutputSink& out, HuffContext::Scratch& s, int threads, bool shared) {
+    // --- Header + decode table ---
+    std::uint32_t block_size = 0;
+    std::uint64_t header_size = 0;
+    const DecodeTable* table = nullptr;
+    if (int rc = read_huf2_header(fi, map, shared, s, block_size, header_size, table)) return rc;
+
+    // a window holds each block's input and output
+    const WorkPlan w = plan_stream(block_size, threads, 2, block_size);
+    BlockWindow& win = s.win;
+    win.table = table;
+    win.threads = w.threads;
+    win.window = w.slots;
+    win.out = &out;
+    win.crc = 0;
+    win.written = 0;
+    win.blocks = 0;
+
+    std::uint64_t orig_size = 0;
+    std::uint32_t crc_expected = 0;
+    int rc = map || is_seekable(fi)
+        ? decode_huf2_indexed(fi, map, block_size, header_size, out, out_path, s, orig_size, crc_expected)
+        : decode_huf2_sequential(fi, block_size, header_size, out, out_path, win, orig_size, crc_expected);
+
+    if (out.close() != 0 && rc == 0) rc = 8;
+    if (rc == 0 && win.crc != crc_expected) {
+        win.bad.bad_length = orig_size;   // every block checked out: the damage is not in one
+        rc = 10; // CRC mismatch
+    }
+    return rc;
+}
+
+// Dispatches on the magic. fi may be null when map holds the whole input.
+static int decompress_any(std::FILE* fi, const MappedInput* map, const char* out_path,
+                          OutputSink& out, HuffContext::Scratch& s, int threads) {
+    uint8_t magic[4];
+    if (!read_header(fi, map, 0, magic, 4)) return 2;
+    if (std::memcmp(magic, HUF2_MAGIC, 4) == 0) return decompress_huf2(fi, map, out_path, out, s, threads, false);
+    if (std::memcmp(magic, HUFD_MAGIC, 4) == 0) return decompress_huf2(fi, map, out_path, out, s, threads, true);
+    if (std::memcmp(magic, HUF1_MAGIC, 4) == 0) return decompress_huf1(fi, map, out_path, out, s);
+    return 2; // bad magic
+}
+
+// ---- HUF2 random access ----
+
+// n bytes at absolute offset off: from the mapping, else one seek + read.
+static bool read_at(std::FILE* fi, const MappedInput* map, std::uint64_t off, void* dst, std::size_t n) {
+    if (map) return off <= map->size && read_header(nullptr, map, (std::size_t)off, dst, n);
+    return seek_to(fi, (std::int64_t)off, SEEK_SET) && read_exact(fi, dst, n);
+}
+
+// Blocks overlapping [offset, offset + length) are decoded a window at a time
+// into s.range_buf; only the requested bytes go on to out.
+static int decode_huf2_range(std::FILE* fi, const MappedInput* map, const char* out_path,
+                             OutputSink& out, HuffContext::Scratch& s, int threads, bool shared,
+                             std::uint64_t offset, std::uint64_t length) {
+    // --- Header ---
+    if (!map && !seek_to(fi, 4, SEEK_SET)) return 3;
+    std::uint32_t block_size = 0;
+    std::uint64_t header_size = 0;
+    const DecodeTable* table = nullptr;
+    if (int rc = read_huf2_header(fi, map, shared, s, block_size, header_size, table)) return rc;
+
+    // --- Footer ---
+    std::uint64_t file_size = 0;
+    if (map) file_size = map->size;
+    else if (seek_to(fi, 0, SEEK_END)) file_size = (std::uint64_t)tell_pos(fi);
+    uint8_t ft[HUF2_FOOTER_SIZE];
+    if (file_size < header_size + HUF2_BLOCK_HEADER_SIZE + HUF2_FOOTER_SIZE ||
+        !read_at(fi, map, file_size - HUF2_FOOTER_SIZE, ft, sizeof ft) ||
+        std::memcmp(ft + HUF2_FOOTER_SIZE - 4, HUF2_MAGIC, 4) != 0)
+        return 11; // missing footer
+    const std::uint64_t orig_size    = load_u64_le(ft);
+    const std::uint32_t nblocks      = load_u32_le(ft + 12);
+    const std::uint64_t index_offset = load_u64_le(ft + 16);
+    if (block_size == 0 || (orig_size + block_size - 1) / block_size != nblocks ||
+        index_offset < header_size + HUF2_BLOCK_HEADER_SIZE ||
+        index_offset + (std::uint64_t)nblocks * HUF2_INDEX_ENTRY_SIZE + HUF2_FOOTER_SIZE != file_size)
+        return 11; // index does not fit, or blocks are not block_size each
+    const std::uint64_t end_marker = index_offset - HUF2_BLOCK_HEADER_SIZE;
+
+    // --- Clamp to the data and open output ---
+    offset = std::min(offset, orig_size);
+    length = std::min(length, orig_size - offset);
+    if (int rc = open_sink(out, out_path, length)) return rc;
+    if (length == 0) return 0;
+
+    // --- Index slice: blocks first..last, plus the next block's offset as the end bound ---
+    const std::uint64_t first = offset / block_size, last = (offset + length - 1) / block_size;
+    const std::size_t n = (std::size_t)(last - first + 1);
+    const std::size_t nread = n + (last + 1 < nblocks ? 1 : 0);
+    {
+        std::vector<uint8_t>& raw = s.win.src_buf;
+        raw.resize(nread * HUF2_INDEX_ENTRY_SIZE);
+        if (!read_at(fi, map, index_offset + first * HUF2_INDEX_ENTRY_SIZE, raw.data(), raw.size()))
+            return 11;
+        s.offsets.resize(nread);
+        s.raw_lens.resize(nread);
+        std::uint64_t prev = header_size;
+        for (std::size_t i = 0; i < nread; ++i) {
+            const uint8_t* e = raw.data() + i * HUF2_INDEX_ENTRY_SIZE;
+            s.offsets[i] = load_u64_le(e);
+            s.raw_lens[i] = load_u32_le(e + 8);
+            const std::uint64_t start = (first + i) * block_size;
+            if (s.raw_lens[i] != std::min<std::uint64_t>(block_size, orig_size - start) ||
+                s.offsets[i] < prev || s.offsets[i] + HUF2_BLOCK_HEADER_SIZE > end_marker)
+                return 11;
+            prev = s.offsets[i] + HUF2_BLOCK_HEADER_SIZE;
+        }
+    }
+
+    // --- Decode a window of blocks at a time, keep the overlap ---
+    const WorkPlan w = plan_stream(block_size, threads, 2, block_size);
+    OutputSink blocks;
+    BlockWindow& win = s.win;
+    win.table = table;
+    win.threads = w.threads;
+    win.out = &blocks;
+    for (std::size_t a = 0; a < n; ) {
+        const std::size_t b = std::min(n, a + w.slots);
+        const std::uint64_t lo = s.offsets[a];
+        const std::uint64_t hi = b < nread ? s.offsets[b] : end_marker;
+
+        win.src_len = (std::size_t)(hi - lo);
+        if (map) {
+            win.src = map->data + lo;
+        } else {
+            StageTimer st(STAGE_READ, win.src_len);
+            win.src_buf.resize(win.src_len);
+            if (!read_at(fi, nullptr, lo, win.src_buf.data(), win.src_len)) return 6; // unexpected EOF
+            win.src = win.src_buf.data();
+        }
+        win.starts.clear();
+        std::uint64_t span = 0;
+        for (std::size_t i = a; i < b; ++i) {
+            win.starts.push_back((std::size_t)(s.offsets[i] - lo));
+            span += s.raw_lens[i];
+        }
+
+        s.range_buf.resize((std::size_t)span);
+        blocks.open_buffer(s.range_buf.data(), s.range_buf.size());
+        win.crc = 0;
+        win.written = 0;
+        if (int rc = win.run(s.raw_lens.data() + a)) return rc;
+
+        const std::uint64_t base = (first + a) * block_size;
+        const std::uint64_t from = std::max(offset, base), to = std::min(offset + length, base + span);
+        uint8_t* dst = out.reserve((std::size_t)(to - from));
+        if (!dst) return 8;
+        std::memcpy(dst, s.range_buf.data() + (from - base), (std::size_t)(to - from));
+        if (!out.commit((std::size_t)(to - from))) return 8;
+        a = b;
+    }
     return 0;
 }
+
+static int decompress_range_any(std::FILE* fi, const MappedInput* map, const char* out_path,
+                                OutputSink& out, HuffContext::Scratch& s, int threads,
+                                std::uint64_t offset, std::uint64_t length) {
+    if (!map && !is_seekable(fi)) return HUFF_ERR_NO_INDEX;
+    uint8_t magic[4];
+    if (!read_at(fi, map, 0, magic, 4)) return 2;
+    if (std::memcmp(magic, HUF1_MAGIC, 4) == 0) return HUFF_ERR_NO_INDEX;
+    const bool shared = std::memcmp(magic, HUFD_MAGIC, 4) == 0;
+    if (!shared && std::memcmp(magic, HUF2_MAGIC, 4) != 0) return 2; // bad magic
+    int rc = decode_huf2_range(fi, map, out_path, out, s, threads, shared, offset, length);
+    if (out.close() != 0 && rc == 0) rc = 8;
+    return rc;
+}
+
+} // namespace
+
+int decompress_file(const char* in_path, const char* out_path, int /*verify*/, int threads) {
+    std::FILE* fi = open_input(in_path);
+    if (!fi) return 1;
+
+    // headers are parsed through fi when the input is not mapped
+    MappedInput mapped;
+    const MappedInput* map = mapped.load(in_path) ? &mapped : nullptr;
+
+    OutputSink out;
+    HuffContext::Scratch s;
+    if (threads <= 0) threads = cpu_topology().cpus;
+    int rc = decompress_any(fi, map, out_path, out, s, threads);
+
+    close_file(fi);
+    return rc;
+}
+
+int test_file(const char* in_path, TestResult& result, int threads) {
+    result = TestResult{};
+    std::FILE* fi = open_input(in_path);
+    if (!fi) return 1;
+
+    MappedInput mapped;
+    const MappedInput* map = mapped.load(in_path) ? &mapped : nullptr;
+
+    OutputSink out;
+    out.open_discard();
+    HuffContext::Scratch s;
+    if (threads <= 0) threads = cpu_topology().cpus;
+    int rc = decompress_any(fi, map, nullptr, out, s, threads);
+    if (rc == 0) result.size = out.pos;
+    else         result = s.win.bad;
+
+    close_file(fi);
+    return rc;
+}
+
+bool decompressed_size(const void* src, std::size_t src_len, std::uint64_t& size) {
+    const uint8_t* p = static_cast<const uint8_t*>(src);
+    if (src_len >= HUF1_HEADER_SIZE && std::memcmp(p, HUF1_MAGIC, 4) == 0) {
+        size = load_u64_le(p + 4);
+        return true;
+    }
+    const bool shared = src_len >= 4 && std::memcmp(p, HUFD_MAGIC, 4) == 0;
+    if (src_len < (shared ? HUFD_HEADER_SIZE : HUF2_HEADER_SIZE) + HUF2_BLOCK_HEADER_SIZE + HUF2_FOOTER_SIZE ||
+        (!shared && std::memcmp(p, HUF2_MAGIC, 4) != 0))
+        return false;
+    const uint8_t* ft = p + src_len - HUF2_FOOTER_SIZE;
+    if (std::memcmp(ft + HUF2_FOOTER_SIZE - 4, HUF2_MAGIC, 4) != 0) return false;
+    size = load_u64_le(ft);
+    return true;
+}
+
+int decompress_buffer(HuffContext& ctx, const void* src, std::size_t src_len,
+                      void* dst, std::size_t dst_cap, std::size_t& out_len) {
+    out_len = 0;
+    MappedInput in;
+    in.view(static_cast<const uint8_t*>(src), src_len);
+    OutputSink out;
+    out.open_buffer(static_cast<uint8_t*>(dst), dst_cap);
+    int rc = decompress_any(nullptr, &in, nullptr, out, *ctx.scratch, ctx.threads);
+    if (rc == 0) out_len = (std::size_t)out.pos;
+    return rc;
+}
+
+int decompress_range(const char* in_path, const char* out_path,
+                     std::uint64_t offset, std::uint64_t length, int threads) {
+    std::FILE* fi = open_input(in_path);
+    if (!fi) return 1;
+
+    MappedInput mapped;
+    const MappedInput* map = mapped.open(in_path) ? &mapped : nullptr;
+
+    OutputSink out;
+    HuffContext::Scratch s;
+    if (threads <= 0) threads = cpu_topology().cpus;
+    int rc = decompress_range_any(fi, map, out_path, out, s, threads, offset, length);
+
+    close_file(fi);
+    return rc;
+}
+
+int decompress_range_buffer(HuffContext& ctx, const void* src, std::size_t src_len,
+                            std::uint64_t offset, std::uint64_t length,
+                            void* dst, std::size_t dst_cap, std::size_t& out_len) {
+    out_len = 0;
+    MappedInput in;
+    in.view(static_cast<const uint8_t*>(src), src_len);
+    OutputSink out;
+    out.open_buffer(static_cast<uint8_t*>(dst), dst_cap);
+    int rc = decompress_range_any(nullptr, &in, nullptr, out, *ctx.scratch, ctx.threads, offset, length);
+    if (rc == 0) out_len = (std::size_t)out.pos;
+    return rc;
+}
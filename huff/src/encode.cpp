@@ -0,0 +1,218 @@
+#include "threads.hpp"
+#include "format.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HUFF_ENCODE_BMI2 1
+#endif
+
+namespace {
+
+// Packed table entry for the merged kernels: code in bits 0..23, length in 24..31.
+constexpr int PACKED_MAX_LEN = 24;
+constexpr std::size_t SEGMENT = 4096;   // symbols per output-buffer resize (within the reserve)
+
+// Worst-case bytes for len symbols of up to max_len bits, plus the slack of
+// the kernels' 8-byte stores and flush(). Every stream of a block gets its own.
+constexpr std::size_t SEGMENT_SLACK = 16;
+inline std::size_t coded_bound(std::size_t len, int max_len) {
+    return (len * std::size_t(max_len) + 7) / 8 + SEGMENT_SLACK;
+}
+
+using Kernel = void (*)(const std::uint8_t*, std::size_t, const std::uint32_t*, int, MemBitWriter&);
+
+// write_bits per code, two codes per call when they fit; any code length.
+void encode_reference(const std::uint8_t* p, std::size_t len,
+                      const std::array<Codeword,256>& table, int max_len,
+                      MemBitWriter& mbw)
+{
+    std::size_t i = 0;
+    if (max_len <= 16) {
+        // two codes per call: <= 31 pending + 32 new bits still fit the accumulator
+        for (; i + 2 <= len; i += 2) {
+            const Codeword& a = table[p[i]];
+            const Codeword& b = table[p[i + 1]];
+            mbw.write_bits((a.code << b.len) | b.code, a.len + b.len);
+        }
+    }
+    for (; i < len; ++i) {
+        const Codeword& cw = table[p[i]];
+        if (cw.len) mbw.write_bits(cw.code, cw.len);
+    }
+}
+
+inline __attribute__((always_inline)) void store_be64(std::uint8_t* out, std::uint64_t v) {
+    v = __builtin_bswap64(v);
+    std::memcpy(out, &v, 8);
+}
+
+// Appends l bits to acc (n pending bits, at most 63 after the add) and stores
+// every whole byte with one unaligned 8-byte write; 0..7 bits stay pending.
+inline __attribute__((always_inline)) void put_bits(std::uint64_t& acc, unsigned& n, std::uint8_t*& out,
+                                                    std::uint64_t c, unsigned l) {
+    acc = (acc << l) | c;
+    n += l;
+    store_be64(out, (acc << 1) << (63 - n));   // top n bits first; n == 0 stores junk but doesn't advance
+    out += n >> 3;
+    n &= 7;
+}
+
+// N codes are merged into one value before touching the accumulator, so the
+// table lookups and shifts of a group don't wait on the previous group's
+// store. 7 pending + N * max_len bits must fit in 63.
+template <int N>
+inline __attribute__((always_inline)) void encode_merged(const std::uint8_t* p, std::size_t len,
+                                                         const std::uint32_t* t, int max_len,
+                                                         MemBitWriter& mbw)
+{
+    // whole bytes of whatever is pending first, so at most 7 bits carry in
+    while (mbw.bits >= 8) {
+        mbw.bits -= 8;
+        mbw.bytes.push_back(std::uint8_t(mbw.acc >> mbw.bits));
+    }
+    std::uint64_t acc = mbw.acc;
+    unsigned n = unsigned(mbw.bits);
+    std::size_t at = mbw.bytes.size();
+
+    for (std::size_t i = 0; i < len; ) {
+        const std::size_t end = std::min(len, i + SEGMENT);
+        // worst case for the segment plus the slack of one 8-byte store
+        mbw.bytes.resize(at + (end - i) * std::size_t(max_len) / 8 + 16);
+        std::uint8_t* out = mbw.bytes.data() + at;
+
+        for (; i + N <= end; i += N) {
+            std::uint64_t c = 0;
+            unsigned l = 0;
+            for (int k = 0; k < N; ++k) {
+                const std::uint32_t e = t[p[i + k]];
+                c = (c << (e >> 24)) | (e & 0xFFFFFFu);
+                l += e >> 24;
+            }
+            put_bits(acc, n, out, c, l);
+        }
+        for (; i < end; ++i) put_bits(acc, n, out, t[p[i]] & 0xFFFFFFu, t[p[i]] >> 24);
+        at = std::size_t(out - mbw.bytes.data());
+    }
+
+    mbw.bytes.resize(at);
+    mbw.acc = acc;
+    mbw.bits = int(n);
+}
+
+// group size from the longest code
+#define HUFF_ENCODE_MERGED_BODY                                                  \
+    switch (56 / max_len) {                                                      \
+    case 1:  encode_merged<1>(p, len, t, max_len, mbw); break;                   \
+    case 2:  encode_merged<2>(p, len, t, max_len, mbw); break;                   \
+    case 3:  encode_merged<3>(p, len, t, max_len, mbw); break;                   \
+    case 4:  encode_merged<4>(p, len, t, max_len, mbw); break;                   \
+    case 5:  encode_merged<5>(p, len, t, max_len, mbw); break;                   \
+    case 6:  encode_merged<6>(p, len, t, max_len, mbw); break;                   \
+    default: encode_merged<7>(p, len, t, max_len, mbw); break;                   \
+    }
+
+void encode_scalar64(const std::uint8_t* p, std::size_t len, const std::uint32_t* t, int max_len,
+                     MemBitWriter& mbw) {
+    HUFF_ENCODE_MERGED_BODY
+}
+
+#ifdef HUFF_ENCODE_BMI2
+// Same kernel; BMI2 turns every variable shift into a flag-free shlx/shrx.
+__attribute__((target("bmi2")))
+void encode_bmi2(const std::uint8_t* p, std::size_t len, const std::uint32_t* t, int max_len,
+                 MemBitWriter& mbw) {
+    HUFF_ENCODE_MERGED_BODY
+}
+#endif
+
+#undef HUFF_ENCODE_MERGED_BODY
+
+struct KernelEntry {
+    const char* name;
+    Kernel fn;          // null: encode_reference
+    bool (*supported)();
+};
+
+bool always() { return true; }
+#ifdef HUFF_ENCODE_BMI2
+bool has_bmi2() { return __builtin_cpu_supports("bmi2"); }
+#endif
+
+// best first
+const KernelEntry KERNELS[] = {
+#ifdef HUFF_ENCODE_BMI2
+    {"bmi2",      encode_bmi2,     has_bmi2},
+#endif
+    {"scalar64",  encode_scalar64, always},
+    {"reference", nullptr,         always},
+};
+
+const KernelEntry*& active_kernel() {
+    static const KernelEntry* k = [] {
+        for (const KernelEntry& e : KERNELS)
+            if (e.supported()) return &e;
+        return &KERNELS[0];
+    }();
+    return k;
+}
+
+} // namespace
+
+const char* encode_kernel_name() {
+    return active_kernel()->name;
+}
+
+bool set_encode_kernel(const char* name) {
+    for (const KernelEntry& e : KERNELS) {
+        if (std::strcmp(e.name, name) != 0) continue;
+        if (!e.supported()) return false;
+        active_kernel() = &e;
+        return true;
+    }
+    return false;
+}
+
+void encode_chunk(const std::uint8_t* p, std::size_t len,
+                  const std::array<Codeword,256>& table,
+                  MemBitWriter& mbw)
+{
+    int max_len = 0;
+    for (const Codeword& cw : table) max_len = std::max(max_len, int(cw.len));
+    mbw.bytes.reserve(mbw.bytes.size() + coded_bound(len, max_len));
+
+    const KernelEntry* k = active_kernel();
+    if (k->fn && max_len >= 1 && max_len <= PACKED_MAX_LEN) {
+        std::uint32_t packed[256];
+        for (int s = 0; s < 256; ++s) packed[s] = table[s].code | (std::uint32_t(table[s].len) << 24);
+        k->fn(p, len, packed, max_len, mbw);
+    } else {
+        encode_reference(p, len, table, max_len, mbw);
+    }
+    mbw.flush();
+}
+
+void encode_chunk_streams(const std::uint8_t* p, std::size_t len,
+                          const std::array<Codeword,256>& table,
+                          int streams, MemBitWriter& mbw)
+{
+    // room for the jump table, patched once the stream sizes are known
+    const std::size_t head = stream_jump_table_size(streams);
+    int max_len = 0;
+    for (const Codeword& cw : table) max_len = std::max(max_len, int(cw.len));
+    mbw.bytes.reserve(head + coded_bound(len, max_len) + std::size_t(streams) * SEGMENT_SLACK);
+    mbw.bytes.assign(head, 0);
+    mbw.bytes[0] = std::uint8_t(streams);
+
+    const std::size_t seg = stream_segment(len, streams);
+    std::size_t start = head;
+    for (int k = 0; k < streams; ++k) {
+        const std::size_t off = std::min(len, seg * std::size_t(k));
+        encode_chunk(p + off, std::min(seg, len - off), table, mbw);   // flush() byte-aligns each stream
+        if (k + 1 < streams) {
+            const std::uint32_t n = std::uint32_t(mbw.bytes.size() - start);
+            for (int b = 0; b < 4; ++b) mbw.bytes[1 + 4 * k + b] = std::uint8_t(n >> (8 * b));
+        }
+        start = mbw.bytes.size();
+    }
+}
@@ -0,0 +1,90 @@
+#include "hist.hpp"
+#include "crc32.hpp"
+#include "threads.hpp"   // parallel_for
+#include "stats.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr std::size_t SUB_BLOCK = std::size_t(1) << 16;   // count + CRC granularity
+constexpr std::size_t FOLD_EVERY = std::size_t(1) << 30;  // keep 32-bit sub-counters safe
+
+inline std::uint64_t load64(const std::uint8_t* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+// four sub-tables; byte k of every 4 goes to table k
+void count4(const std::uint8_t* p, std::size_t len, std::uint32_t (&c)[4][256]) {
+    for (; len >= 16; p += 16, len -= 16) {
+        std::uint64_t a = load64(p), b = load64(p + 8);
+        c[0][a & 0xFF]++;         c[1][(a >> 8) & 0xFF]++;
+        c[2][(a >> 16) & 0xFF]++; c[3][(a >> 24) & 0xFF]++;
+        c[0][(a >> 32) & 0xFF]++; c[1][(a >> 40) & 0xFF]++;
+        c[2][(a >> 48) & 0xFF]++; c[3][a >> 56]++;
+        c[0][b & 0xFF]++;         c[1][(b >> 8) & 0xFF]++;
+        c[2][(b >> 16) & 0xFF]++; c[3][(b >> 24) & 0xFF]++;
+        c[0][(b >> 32) & 0xFF]++; c[1][(b >> 40) & 0xFF]++;
+        c[2][(b >> 48) & 0xFF]++; c[3][b >> 56]++;
+    }
+    for (; len > 0; ++p, --len) c[0][*p]++;
+}
+
+void fold(std::uint32_t (&c)[4][256], std::array<std::uint64_t,256>& freq) {
+    for (int s = 0; s < 256; ++s) {
+        freq[s] += std::uint64_t(c[0][s]) + c[1][s] + c[2][s] + c[3][s];
+        c[0][s] = c[1][s] = c[2][s] = c[3][s] = 0;
+    }
+}
+
+} // namespace
+
+std::uint32_t count_bytes(const std::uint8_t* p, std::size_t len,
+                          std::array<std::uint64_t,256>& freq) {
+    std::uint32_t c[4][256] = {};
+    std::uint32_t crc = 0xFFFFFFFFu;
+    std::size_t since_fold = 0;
+    while (len > 0) {
+        const std::size_t n = std::min(len, SUB_BLOCK);
+        count4(p, n, c);
+        crc = crc32_update(crc, p, n);
+        p += n;
+        len -= n;
+        if ((since_fold += n) >= FOLD_EVERY) { fold(c, freq); since_fold = 0; }
+    }
+    fold(c, freq);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void histogram_parallel(std::span<const std::uint8_t> data, std::size_t chunk_size, int threads,
+                        std::array<std::uint64_t,256>& freq,
+                        std::vector<std::uint32_t>& chunk_crcs,
+                        std::vector<std::array<std::uint64_t,256>>* chunk_freqs) {
+    const std::size_t total = data.size();
+    const std::size_t nchunks = (total + chunk_size - 1) / chunk_size;
+    std::vector<std::array<std::uint64_t,256>> local;
+    auto& part = chunk_freqs ? *chunk_freqs : local;
+    part.resize(nchunks);
+    chunk_crcs.assign(nchunks, 0);
+
+    auto count_chunk = [&](std::size_t i) {
+        const std::size_t off = i * chunk_size;
+        StageTimer st(STAGE_HIST, std::min(chunk_size, total - off));
+        part[i].fill(0);
+        chunk_crcs[i] = count_bytes(data.data() + off, std::min(chunk_size, total - off), part[i]);
+    };
+    if (nchunks == 1) count_chunk(0);   // small input: skip the pool
+    else parallel_for(nchunks, threads, count_chunk);
+
+    for (const auto& f : part)
+        for (int s = 0; s < 256; ++s) freq[s] += f[s];
+}
+
+std::uint64_t coded_bits(const std::array<std::uint64_t,256>& freq,
+                         const std::array<std::uint8_t,256>& lens) {
+    std::uint64_t bits = 0;
+    for (int s = 0; s < 256; ++s) bits += freq[s] * lens[s];
+    return bits;
+}
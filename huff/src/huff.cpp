@@ -1,3 +1,81 @@
-// Keep signatures exactly the same as used in main.cpp
-int compress_file(const char* in_path, const char* out_path, int level);
-int decompress_file(const char* in_path, const char* out_path, int verify);
+// src/huff.cpp
+#include "huff.hpp"
+#include <algorithm>
+
+namespace {
+constexpr int PM_MAX_LEVELS = 32;   // Codeword holds 32-bit codes
+}
+
+std::array<std::uint8_t,256> code_lengths(const std::array<std::uint64_t,256>& freq, int max_len) {
+    std::array<std::uint8_t,256> lens{};
+
+    // symbols in use, cheapest first (ties by symbol, so output is deterministic)
+    std::uint16_t order[256];
+    int n = 0;
+    for (int s = 0; s < 256; ++s)
+        if (freq[s]) order[n++] = std::uint16_t(s);
+    if (n == 0) return lens;
+    if (n == 1) { lens[order[0]] = 1; return lens; }
+    std::sort(order, order + n, [&](std::uint16_t a, std::uint16_t b) {
+        return freq[a] != freq[b] ? freq[a] < freq[b] : a < b;
+    });
+
+    // n <= 256 symbols need at most 8 levels, so raising a small bound stays
+    // well inside is_leaf; the shift is 64-bit for bounds up to 32
+    int limit = std::clamp(max_len, 1, PM_MAX_LEVELS);
+    while (limit < PM_MAX_LEVELS && (std::uint64_t(1) << limit) < std::uint64_t(n)) ++limit;
+
+    // Package-merge: level 0 is the leaves; every further level merges the
+    // leaves with the pairwise packages of the level below. Only whether each
+    // item is a leaf has to be remembered to recover the lengths.
+    std::uint64_t prev[512], cur[512];
+    bool is_leaf[PM_MAX_LEVELS][512];
+    int prev_n = n;
+    for (int i = 0; i < n; ++i) { prev[i] = freq[order[i]]; is_leaf[0][i] = true; }
+
+    for (int l = 1; l < limit; ++l) {
+        const int npkg = prev_n / 2;
+        int leaf = 0, pkg = 0, k = 0;
+        while (leaf < n || pkg < npkg) {
+            const bool take_leaf = pkg >= npkg ||
+                (leaf < n && freq[order[leaf]] <= prev[2 * pkg] + prev[2 * pkg + 1]);
+            if (take_leaf) {
+                cur[k] = freq[order[leaf++]];
+                is_leaf[l][k++] = true;
+            } else {
+                cur[k] = prev[2 * pkg] + prev[2 * pkg + 1];
+                ++pkg;
+                is_leaf[l][k++] = false;
+            }
+        }
+        std::copy(cur, cur + k, prev);
+        prev_n = k;
+    }
+
+    // The cheapest 2n-2 items of the top level form the code. Walk down,
+    // expanding packages; each leaf taken adds one bit to its symbol. Leaves
+    // sit in every level in sorted order, so the ones taken are a prefix.
+    int take = 2 * n - 2;
+    for (int l = limit - 1; l >= 0; --l) {
+        int leaves = 0;
+        for (int i = 0; i < take; ++i) leaves += is_leaf[l][i];
+        for (int i = 0; i < leaves; ++i) lens[order[i]]++;
+        take = 2 * (take - leaves);
+    }
+    return lens;
+}
+
+void canonical_codes(const std::array<std::uint8_t,256>& lens, std::array<std::uint32_t,256>& codes) {
+    std::uint32_t count[PM_MAX_LEVELS + 1] = {};
+    std::uint32_t next[PM_MAX_LEVELS + 1] = {};
+    for (int s = 0; s < 256; ++s)
+        if (lens[s]) count[lens[s]]++;
+
+    std::uint32_t code = 0;
+    for (int l = 1; l <= PM_MAX_LEVELS; ++l) {
+        code = (code + count[l - 1]) << 1;   // count[0] == 0, so the first code is 0
+        next[l] = code;
+    }
+    for (int s = 0; s < 256; ++s)
+        codes[s] = lens[s] ? next[lens[s]]++ : 0;
+}
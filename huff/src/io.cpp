@@ -0,0 +1,479 @@
+#include "io.hpp"
+#include "sched.hpp"   // memory_limit
+#include "stats.hpp"
+#include "uring.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <sys/stat.h>
+#include <cstdint>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+bool is_std_path(const char* path) {
+    return path && !std::strcmp(path, "-");
+}
+
+static std::FILE* as_binary(std::FILE* f) {
+#ifdef _WIN32
+    _setmode(_fileno(f), _O_BINARY);
+#endif
+    return f;
+}
+
+std::FILE* open_input(const char* path) {
+    if (is_std_path(path)) return as_binary(stdin);
+    return std::fopen(path, "rb");
+}
+
+std::FILE* open_output(const char* path) {
+    if (is_std_path(path)) return as_binary(stdout);
+    return std::fopen(path, "wb");
+}
+
+int close_file(std::FILE* f) {
+    if (f == stdin) return 0;
+    if (f == stdout) return std::fflush(f);
+    return std::fclose(f);
+}
+
+bool is_seekable(std::FILE* f) {
+#ifdef _WIN32
+    struct _stat64 st;
+    return _fstat64(_fileno(f), &st) == 0 && (st.st_mode & _S_IFREG);
+#else
+    struct stat st;
+    return fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode);
+#endif
+}
+
+bool seek_to(std::FILE* f, std::int64_t off, int whence) {
+#ifdef _WIN32
+    return _fseeki64(f, off, whence) == 0;
+#else
+    return fseeko(f, (off_t)off, whence) == 0;
+#endif
+}
+
+std::int64_t tell_pos(std::FILE* f) {
+#ifdef _WIN32
+    return _ftelli64(f);
+#else
+    return (std::int64_t)ftello(f);
+#endif
+}
+
+// ---- I/O backend ----
+
+enum IoBackend { IO_STDIO, IO_URING };
+static IoBackend g_io_backend = IO_STDIO;
+static bool g_direct_io = false;
+
+constexpr std::size_t RING_READ_CHUNK = std::size_t(1) << 20;   // bytes per read request
+constexpr unsigned RING_READ_DEPTH   = 8;    // read requests in flight
+constexpr unsigned RING_WRITE_DEPTH  = 64;   // block writes in flight
+constexpr std::size_t DIRECT_ALIGN   = 4096; // O_DIRECT buffer, offset and length alignment
+
+bool set_io_backend(const char* name) {
+    if (!std::strcmp(name, "stdio")) { g_io_backend = IO_STDIO; return true; }
+    if (std::strcmp(name, "uring") != 0) return false;
+    IoRing probe;
+    if (!probe.init(2)) return false;   // no io_uring here: keep stdio
+    g_io_backend = IO_URING;
+    return true;
+}
+
+const char* io_backend_name() {
+    return g_io_backend == IO_URING ? "uring" : "stdio";
+}
+
+void set_direct_io(bool on) { g_direct_io = on; }
+
+// ---- MappedInput ----
+
+bool MappedInput::open(const char* path) {
+    close();
+#ifdef _WIN32
+    (void)path;
+    return false;   // stdio fallback on Windows
+#else
+    if (is_std_path(path)) return false;
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { ::close(fd); return false; }
+    size = (std::size_t)st.st_size;
+    if (size > 0) {
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { ::close(fd); size = 0; return false; }
+        madvise(p, size, MADV_SEQUENTIAL);
+        map = p;
+        data = static_cast<const std::uint8_t*>(p);
+    }
+    ::close(fd);   // the mapping keeps the file referenced
+    opened = true;
+    return true;
+#endif
+}
+
+#ifndef _WIN32
+// The whole file into one page-aligned buffer, RING_READ_DEPTH chunk reads in
+// flight. Any error or short read gives up (after draining the ring) and
+// leaves m closed, so the caller can still map the file.
+static bool ring_read_file(const char* path, MappedInput& m) {
+    int fd = -1;
+#ifdef O_DIRECT
+    if (g_direct_io) fd = ::open(path, O_RDONLY | O_DIRECT);   // EINVAL on tmpfs and the like
+#endif
+    if (fd < 0) fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    IoRing ring;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !ring.init(RING_READ_DEPTH)) { ::close(fd); return false; }
+    const std::size_t size = (std::size_t)st.st_size;
+
+    // whole pages, so an O_DIRECT read of the tail fits too
+    const std::size_t cap = (size + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    void* buf = cap ? std::aligned_alloc(DIRECT_ALIGN, cap) : nullptr;
+    if (cap && !buf) { ::close(fd); return false; }
+
+    StageTimer st_read(STAGE_READ, size);
+    std::uint8_t* p = static_cast<std::uint8_t*>(buf);
+    const std::size_t nreq = (size + RING_READ_CHUNK - 1) / RING_READ_CHUNK;
+    std::size_t queued = 0, reaped = 0;
+    bool ok = true;
+    while (reaped < queued || (ok && queued < nreq)) {
+        while (ok && queued < nreq && queued - reaped < ring.entries()) {
+            const std::uint64_t off = (std::uint64_t)queued * RING_READ_CHUNK;
+            if (!ring.read(fd, p + off, std::min<std::size_t>(RING_READ_CHUNK, cap - off), off, queued)) break;
+            ++queued;
+        }
+        if (reaped == queued) { ok = false; break; }   // nothing could be queued
+        std::uint64_t i;
+        int res;
+        if (!ring.reap(i, res, true)) { ok = false; break; }   // ring unusable: nothing more will land
+        ++reaped;
+        const std::size_t want = std::min<std::size_t>(RING_READ_CHUNK, size - (std::size_t)i * RING_READ_CHUNK);
+        if (res < 0 || (std::size_t)res < want) ok = false;
+    }
+    ::close(fd);
+    if (!ok) {
+        if (!ring.in_flight()) std::free(buf);   // else the kernel may still write into it: leak
+        return false;
+    }
+    m.close();
+    m.heap = buf;
+    m.data = p;
+    m.size = size;
+    m.opened = true;
+    return true;
+}
+#endif
+
+bool MappedInput::load(const char* path) {
+#ifndef _WIN32
+    struct stat st;
+    const bool fits = !memory_limit() || (::stat(path, &st) == 0 && (std::size_t)st.st_size <= memory_limit() / 4);
+    if (g_io_backend == IO_URING && !is_std_path(path) && fits && ring_read_file(path, *this)) return true;
+#endif
+    return open(path);
+}
+
+#ifndef _WIN32
+// Whole pages inside [off, off + n) of a mapping, dropped from the resident
+// set. Returns where the dropped pages end.
+static std::size_t drop_pages(const void* base, std::size_t off, std::size_t n) {
+    static const std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+    const std::size_t lo = (off + page - 1) / page * page, hi = (off + n) / page * page;
+    if (hi <= lo) return off;
+    madvise(static_cast<char*>(const_cast<void*>(base)) + lo, hi - lo, MADV_DONTNEED);
+    return hi;
+}
+#endif
+
+void MappedInput::release(std::size_t off, std::size_t n) const {
+#ifndef _WIN32
+    if (map && off < size) drop_pages(map, off, std::min(n, size - off));
+#else
+    (void)off; (void)n;
+#endif
+}
+
+void MappedInput::view(const std::uint8_t* p, std::size_t n) {
+    close();
+    data = p;
+    size = n;
+    opened = true;
+}
+
+void MappedInput::close() {
+#ifndef _WIN32
+    if (map) munmap(map, size);
+#endif
+    std::free(heap);
+    map = nullptr; heap = nullptr; data = nullptr; size = 0; opened = false;
+}
+
+// ---- OutputSink ----
+
+bool OutputSink::open(const char* path, std::uint64_t sz) {
+    size = sz; pos = 0; dropped = 0;
+#ifndef _WIN32
+    if (!is_std_path(path) && sz != UNKNOWN_SIZE && sz > 0 && sz <= (std::uint64_t)SIZE_MAX) {
+        fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = false;
+#if defined(__linux__)
+        ok = posix_fallocate(fd, 0, (off_t)sz) == 0;   // real blocks, not a sparse file
+#endif
+        if (!ok) ok = ftruncate(fd, (off_t)sz) == 0;
+        if (ok) {
+            void* p = mmap(nullptr, (std::size_t)sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                map = static_cast<std::uint8_t*>(p);
+                return true;
+            }
+        }
+        // not mappable: fall through to stdio on the same path
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    f = open_output(path);
+    return f != nullptr;
+}
+
+void OutputSink::open_buffer(std::uint8_t* p, std::size_t cap) {
+    map = p;
+    size = cap;
+    pos = 0;
+    borrowed = true;
+}
+
+void OutputSink::open_discard() {
+    size = UNKNOWN_SIZE;
+    pos = 0;
+    discard = true;
+}
+
+std::uint8_t* OutputSink::reserve(std::size_t n) {
+    if (map) return n <= size - pos ? map + pos : nullptr;
+    if (buf.size() < n) buf.resize(n);
+    return buf.data();
+}
+
+bool OutputSink::commit(std::size_t n) {
+#ifndef _WIN32
+    // under a memory limit, finished pages of the mapped file go to the page
+    // cache's writeback and out of our resident set, an eighth of it at a time
+    const std::size_t drop_behind = std::clamp(memory_limit() / 8, std::size_t(256) << 10, std::size_t(4) << 20);
+    if (map && fd >= 0 && memory_limit() && pos + n - dropped >= drop_behind) {
+        dropped = drop_pages(map, (std::size_t)dropped, (std::size_t)(pos + n - dropped));
+    }
+#endif
+    if (map || discard) { pos += n; return true; }   // written in place already, or not at all
+    StageTimer st(STAGE_WRITE, n);
+    pos += n;
+    return std::fwrite(buf.data(), 1, n, f) == n;
+}
+
+int OutputSink::close() {
+    int rc = 0;
+    if (borrowed) { map = nullptr; return 0; }
+#ifndef _WIN32
+    if (map) {
+        if (munmap(map, (std::size_t)size) != 0) rc = -1;
+        map = nullptr;
+    }
+    if (fd >= 0) {
+        if (pos != size && ftruncate(fd, (off_t)pos) != 0) rc = -1;  // short output
+        if (::close(fd) != 0) rc = -1;
+        fd = -1;
+    }
+#endif
+    if (f) {
+        if (close_file(f) != 0) rc = -1;
+        f = nullptr;
+    }
+    return rc;
+}
+
+// ---- PositionalOutput ----
+
+// io_uring for queued block writes: one op slot per ring entry, so the
+// submission queue never overflows. Guarded by mu (writer and waiters).
+struct PositionalOutput::Ring {
+    struct Op {
+#ifndef _WIN32
+        struct iovec iov[3];
+#endif
+        int n = 0;
+        std::uint64_t off = 0;
+        std::atomic<bool>* done = nullptr;
+    };
+    IoRing io;
+    std::mutex mu;
+    std::vector<Op> ops;
+    std::vector<std::uint32_t> idle;   // ops not in flight
+};
+
+PositionalOutput::PositionalOutput() = default;
+PositionalOutput::~PositionalOutput() { close(0); }
+
+#ifndef _WIN32
+// One completion: a short write is finished with pwrite, then its done flag
+// clears. If the ring itself fails, every write in flight is given up on.
+static void reap_write(PositionalOutput& po, PositionalOutput::Ring& r) {
+    std::uint64_t user;
+    int res;
+    if (!r.io.reap(user, res, true)) {
+        po.failed = true;
+        std::vector<bool> idle(r.ops.size());
+        for (std::uint32_t i : r.idle) idle[i] = true;
+        for (std::uint32_t i = 0; i < r.ops.size(); ++i) {
+            if (idle[i]) continue;
+            r.ops[i].done->store(false, std::memory_order_release);
+            r.ops[i].done->notify_all();
+            r.idle.push_back(i);
+        }
+        return;
+    }
+    PositionalOutput::Ring::Op& op = r.ops[user];
+    if (res < 0) {
+        po.failed = true;
+    } else {
+        IoPiece rest[3];
+        int k = 0;
+        std::size_t skip = (std::size_t)res;
+        for (int i = 0; i < op.n; ++i) {
+            if (skip >= op.iov[i].iov_len) { skip -= op.iov[i].iov_len; continue; }
+            rest[k++] = {static_cast<const std::uint8_t*>(op.iov[i].iov_base) + skip, op.iov[i].iov_len - skip};
+            skip = 0;
+        }
+        if (k) po.write_at(op.off + (std::uint64_t)res, rest, k);
+    }
+    op.done->store(false, std::memory_order_release);
+    op.done->notify_all();
+    r.idle.push_back((std::uint32_t)user);
+}
+#endif
+
+void PositionalOutput::write_queued(std::uint64_t off, const IoPiece* pieces, int n, std::atomic<bool>* done) {
+#ifndef _WIN32
+    if (n <= 3) {
+        std::lock_guard<std::mutex> lk(ring->mu);
+        while (ring->idle.empty()) reap_write(*this, *ring);
+        const std::uint32_t i = ring->idle.back();
+        Ring::Op& op = ring->ops[i];
+        op.n = n;
+        op.off = off;
+        op.done = done;
+        for (int k = 0; k < n; ++k) op.iov[k] = {const_cast<void*>(pieces[k].p), pieces[k].n};
+        if (ring->io.writev(fd, op.iov, n, off, i) && ring->io.submit()) {
+            ring->idle.pop_back();
+            return;
+        }
+    }
+#endif
+    write_at(off, pieces, n);   // more pieces than an op holds, or the ring refused it
+    done->store(false, std::memory_order_release);
+    done->notify_all();
+}
+
+void PositionalOutput::wait(const std::atomic<bool>& done) {
+#ifndef _WIN32
+    std::lock_guard<std::mutex> lk(ring->mu);
+    while (done.load(std::memory_order_acquire)) reap_write(*this, *ring);
+#else
+    (void)done;
+#endif
+}
+
+bool PositionalOutput::open(const char* path, std::uint64_t size_hint) {
+#ifdef _WIN32
+    (void)path; (void)size_hint;
+    return false;
+#else
+    if (is_std_path(path)) return false;
+    struct stat st;
+    if (::stat(path, &st) == 0 && !S_ISREG(st.st_mode)) return false;   // FIFO, device: keep stdio
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    failed = false;
+#if defined(__linux__)
+    if (size_hint > 0) posix_fallocate(fd, 0, (off_t)size_hint);   // best effort: contiguous extents
+#else
+    (void)size_hint;
+#endif
+    if (g_io_backend == IO_URING) {
+        ring = std::make_unique<Ring>();
+        if (ring->io.init(RING_WRITE_DEPTH)) {
+            ring->ops.resize(ring->io.entries());
+            for (std::uint32_t i = ring->io.entries(); i-- > 0; ) ring->idle.push_back(i);
+        } else {
+            ring.reset();   // blocking pwrite after all
+        }
+    }
+    return true;
+#endif
+}
+
+bool PositionalOutput::write_at(std::uint64_t off, const IoPiece* pieces, int n) {
+#ifndef _WIN32
+    int k = 0;
+    std::size_t done = 0;   // bytes of pieces[k] already written
+#if defined(__linux__)
+    // one syscall for the header and body in the common case
+    struct iovec iov[8] = {};
+    if (n <= 8) {
+        for (int i = 0; i < n; ++i) iov[i] = {const_cast<void*>(pieces[i].p), pieces[i].n};
+        ssize_t w = pwritev(fd, iov, n, (off_t)off);
+        if (w < 0) { failed = true; return false; }
+        off += (std::uint64_t)w;
+        std::size_t left = (std::size_t)w;
+        while (k < n && left >= pieces[k].n) left -= pieces[k++].n;
+        done = left;
+    }
+#endif
+    // short writes and the portable path: the rest piece by piece
+    for (; k < n; ++k, done = 0) {
+        const std::uint8_t* p = static_cast<const std::uint8_t*>(pieces[k].p) + done;
+        for (std::size_t left = pieces[k].n - done; left > 0; ) {
+            ssize_t w = pwrite(fd, p, left, (off_t)off);
+            if (w <= 0) { failed = true; return false; }
+            p += w; off += (std::uint64_t)w; left -= (std::size_t)w;
+        }
+    }
+    return true;
+#else
+    (void)off; (void)pieces; (void)n;
+    return false;
+#endif
+}
+
+int PositionalOutput::close(std::uint64_t final_size) {
+    if (fd < 0) return 0;
+#ifndef _WIN32
+    if (ring) {
+        std::lock_guard<std::mutex> lk(ring->mu);
+        while (ring->idle.size() < ring->ops.size()) reap_write(*this, *ring);
+    }
+    ring.reset();
+#endif
+    int rc = failed ? -1 : 0;
+#ifndef _WIN32
+    if (ftruncate(fd, (off_t)final_size) != 0) rc = -1;   // drop the unused preallocation
+    if (::close(fd) != 0) rc = -1;
+#endif
+    fd = -1;
+    return rc;
+}
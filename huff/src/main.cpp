@@ -2,31 +2,223 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 
-#include "huff.hpp"  // declares: int compress_file(const char*, const char*, int);
-                    //           int decompress_file(const char*, const char*, int);
+#include "bench.hpp"
+#include "huff.hpp"  // declares: int compress_file(const char*, const char*, const CompressOptions&);
+                    //           int decompress_file(const char*, const char*, int, int);
+#include "format.hpp"   // HUF2_BLOCK_SIZE
+#include "threads.hpp"  // parallel_for
+#include "stats.hpp"
+#include "sched.hpp"    // cpu_topology
+#include "hist.hpp"     // count_bytes
+#include "io.hpp"       // MappedInput
+#include "arena.hpp"    // set_huge_pages
+
+namespace fs = std::filesystem;
 
 struct Options {
-    enum Mode { None, Compress, Decompress } mode = None;
+    enum Mode { None, Compress, Decompress, Test } mode = None;
     std::string in, out;
-    int level = 5;     // default compression level (0..9? you decide later)
-    int verify = 0;    // 1 to verify after decompress
+    int threads = 0;   // -l: thread cap, 0 = picked per input (sched.hpp)
+    int verify = 0;    // 1 to verify after decompress (CRCs are always checked)
+    int format = 2;    // container written by -c: 2 = indexed HUF2, 1 = legacy HUF1
+    bool stream = false; // -c in bounded memory, block by block
+    int max_len = HUFF_MAX_CODE_LEN; // longest Huffman code in bits
+    int streams = 4;   // interleaved sub-streams per HUF2 block
+    bool batch = false; // input is a directory or a list of files, -o a directory
+    bool stats = false; // per-stage summary on stderr when done
+    std::string trace;  // Chrome trace-event JSON of every thread's stages
+    bool range = false; // -d only [range_off, range_off + range_len) of the original
+    std::uint64_t range_off = 0, range_len = 0;
+    std::string table;  // shared code table from `huff train`
+    std::string io;     // I/O backend: "stdio" or "uring" (io.hpp), empty = default
+    bool direct = false; // O_DIRECT input reads (uring)
+    std::size_t memory_limit = 0; // working-memory budget in bytes, 0 = none (sched.hpp)
+    bool huge_pages = false; // chunk buffers on transparent huge pages (arena.hpp)
+};
+
+struct TrainOptions {
+    std::vector<std::string> inputs;   // sample files and directories
+    std::string out;
+    int max_len = HUFF_MAX_CODE_LEN;
 };
 
 static void print_usage(const char* prog) {
     std::cerr <<
         "Usage:\n"
-        "  " << prog << " -c <input> -o <output> [-l <level>]\n"
-        "  " << prog << " -d <input> -o <output> [--verify]\n"
+        "  " << prog << " -c <input> -o <output> [-l <threads>] [--format <1|2>] [--stream] [--max-len <n>] [--streams <n>] [--stats] [--trace <file>]\n"
+        "  " << prog << " -d <input> -o <output> [-l <threads>] [--verify] [--range <offset:length>] [--stats] [--trace <file>]\n"
+        "  " << prog << " -t <input> [-l <threads>] [--table <file>]\n"
+        "  " << prog << " -c|-d|-t <dir|list> --batch [-o <dir>] [options]\n"
+        "  " << prog << " train <file|dir>... -o <table> [--max-len <n>]\n"
+        "  " << prog << " bench [--size <MiB>] [--iters <n>] [--threads <n,...>] [--corpus <name,...>] [--kernel <name>] [--json <file>]\n"
         "\n"
         "Options:\n"
         "  -c              Compress mode\n"
         "  -d              Decompress mode\n"
-        "  -o <file>       Output file path\n"
-        "  -l <level>      Compression level (integer, default 5)\n"
+        "  -t, --test      Decode and check every CRC without writing any output;\n"
+        "                  reports the first bad block of a damaged file\n"
+        "  -o <file>       Output file path (\"-\" for stdout; input \"-\" reads stdin)\n"
+        "  -l <threads>    Threads to use at most (default: from input size and cores)\n"
+        "  --format <n>    Container to write: 2 = indexed blocks (default), 1 = legacy HUF1\n"
+        "  --stream        Compress block by block in bounded memory (implied for stdin)\n"
+        "  --max-len <n>   Longest code in bits, 8..15 (default 15)\n"
+        "  --streams <n>   Sub-streams per block for faster decoding, 1..8 (default 4)\n"
         "  --verify        Verify integrity after decompression\n"
-        "  -h, --help      Show this help\n";
+        "  --range <o:n>   Decompress only n bytes from offset o (HUF2, seekable input)\n"
+        "  --batch         Input is a directory (walked recursively) or a file listing\n"
+        "                  one path per line; each file gets its own output, mirrored\n"
+        "                  under -o <dir> or written next to it (.huf added / removed)\n"
+        "  --io <name>     I/O backend: stdio (default) or uring (Linux io_uring, several\n"
+        "                  reads and writes in flight; falls back to stdio if unavailable)\n"
+        "  --direct        With --io uring, read inputs with O_DIRECT (no page cache)\n"
+        "  --memory-limit <size>\n"
+        "                  Keep working memory under size (K, M or G suffix): fewer\n"
+        "                  blocks in flight and fewer threads, not failure; the peak\n"
+        "                  resident size is reported when done\n"
+        "  --huge-pages    Back large chunk buffers with transparent huge pages (Linux)\n"
+        "  --stats         Print per-stage time, bytes and pool use to stderr\n"
+        "  --trace <file>  Write a Chrome/Perfetto trace of every thread's stages\n"
+        "  --table <file>  Shared code table from `train`: -c codes with it (no\n"
+        "                  histogram, no lengths in the file), -d needs it for such files\n"
+        "  -h, --help      Show this help\n"
+        "\n"
+        "Bench (in-memory round trips over seeded synthetic data):\n"
+        "  --size <MiB>    Bytes per corpus (default 16)\n"
+        "  --iters <n>     Timed runs per case, fastest counts (default 5)\n"
+        "  --threads <l>   Thread counts to compare (default 1, 2, 4, ... cores)\n"
+        "  --corpus <l>    random, zipf, text, same, compressed (default all)\n"
+        "  --kernel <name> Encode kernel: bmi2, scalar64, reference (default: best supported)\n"
+        "  --json <file>   Also write the results as JSON (\"-\" for stdout)\n"
+        "\n"
+        "Train (one code table from the byte counts of all samples; directories are walked):\n"
+        "  -o <table>      Table file to write\n"
+        "  --max-len <n>   Longest code in bits, 8..15 (default 15)\n";
+}
+
+// "64M", "1G", "65536" -> bytes; 0 if malformed, negative or too large.
+static std::size_t parse_size(const std::string& v) {
+    // stoull skips blanks and takes a sign ("-1" wraps to 2^64 - 1): digits only
+    if (v.empty() || v[0] < '0' || v[0] > '9') return 0;
+    std::size_t end = 0;
+    unsigned long long n = 0;
+    try {
+        n = std::stoull(v, &end);
+    } catch (...) {
+        return 0;
+    }
+    const std::string unit = v.substr(end);
+    int shift = 0;
+    if (unit == "K" || unit == "k") shift = 10;
+    else if (unit == "M" || unit == "m") shift = 20;
+    else if (unit == "G" || unit == "g") shift = 30;
+    else if (!unit.empty()) return 0;
+    if (n > (SIZE_MAX >> shift)) return 0;
+    return std::size_t(n) << shift;
+}
+
+// Comma-separated list into items; false on an empty item.
+static bool split_list(const char* s, std::vector<std::string>& items) {
+    items.clear();
+    std::string cur;
+    for (const char* p = s; ; ++p) {
+        if (*p == ',' || *p == '\0') {
+            if (cur.empty()) return false;
+            items.push_back(cur);
+            cur.clear();
+            if (!*p) return true;
+        } else {
+            cur += *p;
+        }
+    }
+}
+
+static bool parse_bench(int argc, char** argv, BenchOptions& b) {
+    for (int i = 2; i < argc; ++i) {
+        const char* a = argv[i];
+        if (i + 1 >= argc || a[0] != '-') {
+            std::cerr << (a[0] == '-' ? "Missing value for " : "Unexpected argument: ") << a << "\n";
+            return false;
+        }
+        const char* v = argv[++i];
+        std::vector<std::string> items;
+        try {
+            if (!std::strcmp(a, "--size")) {
+                const int mib = std::stoi(v);
+                if (mib < 1) throw 0;
+                b.size = std::size_t(mib) << 20;
+            } else if (!std::strcmp(a, "--iters")) {
+                b.iters = std::stoi(v);
+                if (b.iters < 1) throw 0;
+            } else if (!std::strcmp(a, "--threads")) {
+                if (!split_list(v, items)) throw 0;
+                for (const auto& t : items) {
+                    b.threads.push_back(std::stoi(t));
+                    if (b.threads.back() < 1) throw 0;
+                }
+            } else if (!std::strcmp(a, "--corpus")) {
+                if (!split_list(v, items)) throw 0;
+                for (const auto& c : items) {
+                    const auto& known = bench_corpora();
+                    if (std::find(known.begin(), known.end(), c) == known.end()) {
+                        std::cerr << "Unknown corpus '" << c << "'.\n";
+                        return false;
+                    }
+                }
+                b.corpora = items;
+            } else if (!std::strcmp(a, "--json")) {
+                b.json = v;
+            } else if (!std::strcmp(a, "--kernel")) {
+                b.kernel = v;
+            } else {
+                std::cerr << "Unknown bench option: " << a << "\n";
+                return false;
+            }
+        } catch (...) {
+            std::cerr << "Invalid value for " << a << ".\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_train(int argc, char** argv, TrainOptions& t) {
+    for (int i = 2; i < argc; ++i) {
+        const char* a = argv[i];
+        if (a[0] != '-' || !std::strcmp(a, "-")) {
+            t.inputs.push_back(a);
+            continue;
+        }
+        if (i + 1 >= argc) { std::cerr << "Missing value for " << a << "\n"; return false; }
+        const char* v = argv[++i];
+        if (!std::strcmp(a, "-o")) {
+            t.out = v;
+        } else if (!std::strcmp(a, "--max-len")) {
+            try {
+                t.max_len = std::stoi(v);
+            } catch (...) {
+                t.max_len = 0;
+            }
+            if (t.max_len < HUFF_MIN_CODE_LEN || t.max_len > HUFF_MAX_CODE_LEN) {
+                std::cerr << "--max-len must be between " << HUFF_MIN_CODE_LEN
+                          << " and " << HUFF_MAX_CODE_LEN << ".\n";
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown train option: " << a << "\n";
+            return false;
+        }
+    }
+    if (t.inputs.empty() || t.out.empty()) {
+        std::cerr << "train needs sample files and -o <table>.\n";
+        return false;
+    }
+    return true;
 }
 
 static bool parse_args(int argc, char** argv, Options& opt) {
@@ -38,28 +230,105 @@ static bool parse_args(int argc, char** argv, Options& opt) {
         if (!std::strcmp(a, "-h") || !std::strcmp(a, "--help")) {
             return false; // triggers usage
         } else if (!std::strcmp(a, "-c")) {
-            if (opt.mode != Options::None) { std::cerr << "Choose only one of -c or -d.\n"; return false; }
+            if (opt.mode != Options::None) { std::cerr << "Choose only one of -c, -d or -t.\n"; return false; }
             opt.mode = Options::Compress;
             if (i + 1 >= argc) { std::cerr << "-c requires an input file.\n"; return false; }
             opt.in = argv[++i];
         } else if (!std::strcmp(a, "-d")) {
-            if (opt.mode != Options::None) { std::cerr << "Choose only one of -c or -d.\n"; return false; }
+            if (opt.mode != Options::None) { std::cerr << "Choose only one of -c, -d or -t.\n"; return false; }
             opt.mode = Options::Decompress;
             if (i + 1 >= argc) { std::cerr << "-d requires an input file.\n"; return false; }
             opt.in = argv[++i];
+        } else if (!std::strcmp(a, "-t") || !std::strcmp(a, "--test")) {
+            if (opt.mode != Options::None) { std::cerr << "Choose only one of -c, -d or -t.\n"; return false; }
+            opt.mode = Options::Test;
+            if (i + 1 >= argc) { std::cerr << a << " requires an input file.\n"; return false; }
+            opt.in = argv[++i];
         } else if (!std::strcmp(a, "-o")) {
             if (i + 1 >= argc) { std::cerr << "-o requires an output file.\n"; return false; }
             opt.out = argv[++i];
         } else if (!std::strcmp(a, "-l")) {
-            if (i + 1 >= argc) { std::cerr << "-l requires a level integer.\n"; return false; }
+            if (i + 1 >= argc) { std::cerr << "-l requires a thread count.\n"; return false; }
             try {
-                opt.level = std::stoi(argv[++i]);
+                opt.threads = std::stoi(argv[++i]);
+                if (opt.threads < 1) throw 0;
             } catch (...) {
-                std::cerr << "Invalid level for -l.\n"; return false;
+                std::cerr << "Invalid thread count for -l.\n"; return false;
+            }
+        } else if (!std::strcmp(a, "--format")) {
+            if (i + 1 >= argc) { std::cerr << "--format requires 1 or 2.\n"; return false; }
+            const char* v = argv[++i];
+            if (!std::strcmp(v, "1")) opt.format = 1;
+            else if (!std::strcmp(v, "2")) opt.format = 2;
+            else { std::cerr << "Invalid format for --format (use 1 or 2).\n"; return false; }
+        } else if (!std::strcmp(a, "--max-len")) {
+            if (i + 1 >= argc) { std::cerr << "--max-len requires a bit count.\n"; return false; }
+            try {
+                opt.max_len = std::stoi(argv[++i]);
+            } catch (...) {
+                std::cerr << "Invalid value for --max-len.\n"; return false;
+            }
+            if (opt.max_len < HUFF_MIN_CODE_LEN || opt.max_len > HUFF_MAX_CODE_LEN) {
+                std::cerr << "--max-len must be between " << HUFF_MIN_CODE_LEN
+                          << " and " << HUFF_MAX_CODE_LEN << ".\n";
+                return false;
+            }
+        } else if (!std::strcmp(a, "--streams")) {
+            if (i + 1 >= argc) { std::cerr << "--streams requires a count.\n"; return false; }
+            try {
+                opt.streams = std::stoi(argv[++i]);
+            } catch (...) {
+                std::cerr << "Invalid value for --streams.\n"; return false;
+            }
+            if (opt.streams < 1 || opt.streams > 8) {
+                std::cerr << "--streams must be between 1 and 8.\n";
+                return false;
+            }
+        } else if (!std::strcmp(a, "--stream")) {
+            opt.stream = true;
+        } else if (!std::strcmp(a, "--batch")) {
+            opt.batch = true;
+        } else if (!std::strcmp(a, "--stats")) {
+            opt.stats = true;
+        } else if (!std::strcmp(a, "--trace")) {
+            if (i + 1 >= argc) { std::cerr << "--trace requires an output file.\n"; return false; }
+            opt.trace = argv[++i];
+        } else if (!std::strcmp(a, "--range")) {
+            if (i + 1 >= argc) { std::cerr << "--range requires <offset:length>.\n"; return false; }
+            const std::string v = argv[++i];
+            const std::size_t colon = v.find(':');
+            try {
+                std::size_t end1 = 0, end2 = 0;
+                if (colon == std::string::npos) throw 0;
+                opt.range_off = std::stoull(v.substr(0, colon), &end1);
+                opt.range_len = std::stoull(v.substr(colon + 1), &end2);
+                if (end1 != colon || end2 != v.size() - colon - 1) throw 0;
+            } catch (...) {
+                std::cerr << "Invalid value for --range (use <offset:length> in bytes).\n"; return false;
+            }
+            opt.range = true;
+        } else if (!std::strcmp(a, "--table")) {
+            if (i + 1 >= argc) { std::cerr << "--table requires a table file.\n"; return false; }
+            opt.table = argv[++i];
+        } else if (!std::strcmp(a, "--io")) {
+            if (i + 1 >= argc) { std::cerr << "--io requires stdio or uring.\n"; return false; }
+            opt.io = argv[++i];
+            if (opt.io != "stdio" && opt.io != "uring") {
+                std::cerr << "Invalid backend for --io (use stdio or uring).\n"; return false;
+            }
+        } else if (!std::strcmp(a, "--direct")) {
+            opt.direct = true;
+        } else if (!std::strcmp(a, "--huge-pages")) {
+            opt.huge_pages = true;
+        } else if (!std::strcmp(a, "--memory-limit")) {
+            if (i + 1 >= argc) { std::cerr << "--memory-limit requires a size.\n"; return false; }
+            opt.memory_limit = parse_size(argv[++i]);
+            if (!opt.memory_limit) {
+                std::cerr << "Invalid size for --memory-limit (e.g. 64M or 1G).\n"; return false;
             }
         } else if (!std::strcmp(a, "--verify")) {
             opt.verify = 1;
-        } else if (a[0] == '-') {
+        } else if (a[0] == '-' && a[1] != '\0') {
             std::cerr << "Unknown option: " << a << "\n";
             return false;
         } else {
@@ -74,44 +343,291 @@ static bool parse_args(int argc, char** argv, Options& opt) {
     }
 
     if (opt.mode == Options::None) {
-        std::cerr << "You must specify -c or -d.\n";
+        std::cerr << "You must specify -c, -d or -t.\n";
         return false;
     }
     if (opt.in.empty()) {
-        std::cerr << "Missing input file (use -c <in> or -d <in>).\n";
+        std::cerr << "Missing input file (use -c <in>, -d <in> or -t <in>).\n";
+        return false;
+    }
+    if (opt.batch && opt.in == "-") {
+        std::cerr << "--batch needs a directory or a list file, not stdin.\n";
+        return false;
+    }
+    if (opt.range && (opt.mode != Options::Decompress || opt.batch)) {
+        std::cerr << "--range only applies to a single -d.\n";
+        return false;
+    }
+    if (opt.mode == Options::Test && !opt.out.empty()) {
+        std::cerr << "-t writes no output; drop -o.\n";
         return false;
     }
-    if (opt.out.empty()) {
+    if (opt.out.empty() && !opt.batch && opt.mode != Options::Test) {
         std::cerr << "Missing output file (-o <out>).\n";
         return false;
     }
+    if (opt.mode == Options::Compress && opt.format == 1 && !opt.table.empty()) {
+        std::cerr << "--table writes HUF2 only; drop --format 1.\n";
+        return false;
+    }
+    if (opt.mode == Options::Compress && opt.format == 1 && (opt.stream || opt.in == "-")) {
+        std::cerr << "HUF1 needs the whole input up front; --stream and stdin require --format 2.\n";
+        return false;
+    }
     return true;
 }
 
-int main(int argc, char** argv) {
-    Options opt;
-    if (!parse_args(argc, argv, opt)) {
-        print_usage(argv[0]);
-        return 2; // usage error
+// ---- batch mode ----
+
+struct BatchJob {
+    std::string in, out;
+    std::uintmax_t size = 0;
+    int rc = 0;
+    TestResult test;   // -t: where a damaged file failed
+};
+
+// "Test failed for 'x' (code 10) in block 3 at bytes 3145728+1048576."
+static void report_test_failure(const std::string& in, int rc, const TestResult& r) {
+    std::cerr << "Test failed for '" << in << "' (code " << rc << ")";
+    if (r.bad_block >= 0) std::cerr << " in block " << r.bad_block;
+    if (r.bad_length) std::cerr << " at bytes " << r.bad_offset << "+" << r.bad_length;
+    std::cerr << ".\n";
+}
+
+// -c adds .huf; -d drops it (or adds .out when it is missing).
+static std::string batch_output(const Options& opt, const fs::path& in, const fs::path& rel) {
+    fs::path out = opt.out.empty() ? in : fs::path(opt.out) / rel;
+    if (opt.mode == Options::Compress) out += ".huf";
+    else if (out.extension() == ".huf") out.replace_extension();
+    else out += ".out";
+    return out.string();
+}
+
+// Every regular file under a directory, or one path per line of a list file.
+// Under -o, directory entries keep their relative path and list entries their file name.
+static bool collect_batch(const Options& opt, std::vector<BatchJob>& jobs) {
+    std::error_code ec;
+    if (fs::is_directory(opt.in, ec)) {
+        for (fs::recursive_directory_iterator it(opt.in, ec), end; !ec && it != end; it.increment(ec)) {
+            if (!it->is_regular_file(ec)) continue;
+            const fs::path& p = it->path();
+            jobs.push_back({p.string(), batch_output(opt, p, p.lexically_relative(opt.in)), it->file_size(ec), 0, {}});
+        }
+        if (ec) return false;
+    } else {
+        std::ifstream list(opt.in);
+        if (!list) return false;
+        for (std::string line; std::getline(list, line); ) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            const fs::path p(line);
+            std::uintmax_t size = fs::file_size(p, ec);
+            jobs.push_back({line, batch_output(opt, p, p.filename()), ec ? 0 : size, 0, {}});   // open errors surface per job
+        }
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.in < b.in; });
+    return true;
+}
+
+// Files of up to a block per core run whole and single-threaded, one per pool
+// task, so many small files scale with cores. Larger files follow one at a
+// time with their chunks spread over the same pool. Under a memory limit only
+// as many small files run at once as their blocks in flight fit.
+static int run_batch(const Options& opt, const CompressOptions& copt, std::ostream& status) {
+    std::vector<BatchJob> jobs;
+    if (!collect_batch(opt, jobs)) {
+        std::cerr << "Cannot read batch input '" << opt.in << "'.\n";
+        return 1;
+    }
+
+    const int threads = opt.threads > 0 ? opt.threads : cpu_topology().cpus;
+    const std::uintmax_t whole_max = (std::uintmax_t)HUF2_BLOCK_SIZE * (std::uintmax_t)threads;
+    std::vector<BatchJob*> small, large;
+    for (auto& j : jobs) (j.size <= whole_max ? small : large).push_back(&j);
+
+    auto run = [&](BatchJob& j, int t) {
+        if (opt.mode == Options::Test) { j.rc = test_file(j.in.c_str(), j.test, t); return; }
+        std::error_code ec;
+        const fs::path dir = fs::path(j.out).parent_path();
+        if (!dir.empty()) fs::create_directories(dir, ec);
+        if (opt.mode == Options::Compress) {
+            CompressOptions o = copt;
+            o.threads = t;
+            j.rc = compress_file(j.in.c_str(), j.out.c_str(), o);
+        } else {
+            j.rc = decompress_file(j.in.c_str(), j.out.c_str(), opt.verify, t);
+        }
+    };
+    int concurrent = threads;
+    if (memory_limit())
+        concurrent = (int)std::clamp<std::size_t>(memory_limit() / (SCHED_CHUNK_COPIES * HUF2_BLOCK_SIZE),
+                                                  1, (std::size_t)threads);
+    parallel_for(small.size(), concurrent, [&](std::size_t i) { run(*small[i], 1); });
+    for (BatchJob* j : large) run(*j, threads);
+
+    int rc = 0;
+    std::size_t failed = 0;
+    for (const auto& j : jobs) {
+        if (!j.rc) continue;
+        if (opt.mode == Options::Test) report_test_failure(j.in, j.rc, j.test);
+        else std::cerr << (opt.mode == Options::Compress ? "Compression" : "Decompression")
+                       << " failed for '" << j.in << "' (code " << j.rc << ").\n";
+        if (!rc) rc = j.rc;
+        ++failed;
+    }
+    static const char* const done[] = {"", "Compressed ", "Decompressed ", "Tested OK: "};
+    status << done[opt.mode]
+           << jobs.size() - failed << " of " << jobs.size() << " files from '" << opt.in << "'\n";
+    return rc;
+}
+
+// ---- train ----
+
+// Byte counts of every sample (directories walked recursively) -> one table file.
+static int run_train(const TrainOptions& t) {
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (const auto& in : t.inputs) {
+        if (!fs::is_directory(in, ec)) { files.push_back(in); continue; }
+        for (fs::recursive_directory_iterator it(in, ec), end; !ec && it != end; it.increment(ec))
+            if (it->is_regular_file(ec)) files.push_back(it->path().string());
+        if (ec) { std::cerr << "Cannot read directory '" << in << "'.\n"; return 1; }
+    }
+
+    std::array<std::uint64_t,256> freq{};
+    std::uint64_t total = 0;
+    for (const auto& f : files) {
+        MappedInput m;
+        std::vector<std::uint8_t> buf;
+        const std::uint8_t* p = nullptr;
+        std::size_t n = 0;
+        if (m.open(f.c_str())) {
+            p = m.data; n = m.size;
+        } else {
+            std::ifstream is(f, std::ios::binary);
+            if (!is) { std::cerr << "Cannot read sample '" << f << "'.\n"; return 1; }
+            buf.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+            p = buf.data(); n = buf.size();
+        }
+        count_bytes(p, n, freq);
+        total += n;
     }
+    if (total == 0) { std::cerr << "No sample bytes to train on.\n"; return 1; }
 
+    const SharedTable table = train_table(freq, t.max_len);
+    if (save_table(t.out.c_str(), table) != 0) {
+        std::cerr << "Cannot write table '" << t.out << "'.\n";
+        return 1;
+    }
+    std::uint64_t bits = 0;
+    for (int s = 0; s < 256; ++s) bits += freq[s] * table.lengths[s];
+    char id[16];
+    std::snprintf(id, sizeof id, "%08x", table.id);
+    std::cout << "Trained table " << id << " on " << files.size() << " file(s), " << total
+              << " bytes (" << double(bits) / double(total) << " bits/byte) -> '" << t.out << "'\n";
+    return 0;
+}
+
+static int run_single(const Options& opt, const CompressOptions& copt, std::ostream& status) {
     int rc = 1;
     if (opt.mode == Options::Compress) {
-        rc = compress_file(opt.in.c_str(), opt.out.c_str(), opt.level);
+        rc = compress_file(opt.in.c_str(), opt.out.c_str(), copt);
         if (rc != 0) {
             std::cerr << "Compression failed (code " << rc << ").\n";
             return rc;
         }
-        std::cout << "Compressed '" << opt.in << "' -> '" << opt.out
-                  << "' (level " << opt.level << ")\n";
+        status << "Compressed '" << opt.in << "' -> '" << opt.out << "'";
+        if (opt.threads) status << " (" << opt.threads << (opt.threads == 1 ? " thread)" : " threads)");
+        status << "\n";
+    } else if (opt.mode == Options::Test) {
+        TestResult r;
+        rc = test_file(opt.in.c_str(), r, opt.threads);
+        if (rc != 0) {
+            report_test_failure(opt.in, rc, r);
+            return rc;
+        }
+        status << "Tested '" << opt.in << "': OK, " << r.size << " bytes\n";
+    } else if (opt.range) {
+        rc = decompress_range(opt.in.c_str(), opt.out.c_str(), opt.range_off, opt.range_len, opt.threads);
+        if (rc != 0) {
+            std::cerr << "Range decompression failed (code " << rc << ").\n";
+            return rc;
+        }
+        status << "Decompressed bytes " << opt.range_off << "+" << opt.range_len << " of '"
+               << opt.in << "' -> '" << opt.out << "'\n";
     } else {
-        rc = decompress_file(opt.in.c_str(), opt.out.c_str(), opt.verify);
+        rc = decompress_file(opt.in.c_str(), opt.out.c_str(), opt.verify, opt.threads);
         if (rc != 0) {
             std::cerr << "Decompression failed (code " << rc << ").\n";
             return rc;
         }
-        std::cout << "Decompressed '" << opt.in << "' -> '" << opt.out
+        status << "Decompressed '" << opt.in << "' -> '" << opt.out
                   << "'" << (opt.verify ? " [verified]" : "") << "\n";
     }
     return 0;
 }
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && !std::strcmp(argv[1], "bench")) {
+        BenchOptions b;
+        if (!parse_bench(argc, argv, b)) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        return run_bench(b);
+    }
+    if (argc >= 2 && !std::strcmp(argv[1], "train")) {
+        TrainOptions t;
+        if (!parse_train(argc, argv, t)) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        return run_train(t);
+    }
+
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        print_usage(argv[0]);
+        return 2; // usage error
+    }
+
+    // keep stdout clean when it carries the data
+    std::ostream& status = (opt.out == "-") ? std::cerr : std::cout;
+
+    CompressOptions copt;
+    copt.threads = opt.threads;
+    copt.format = opt.format;
+    copt.stream = opt.stream;
+    copt.max_code_len = opt.max_len;
+    copt.streams = opt.streams;
+
+    SharedTable table;
+    if (!opt.table.empty()) {
+        if (load_table(opt.table.c_str(), table) != 0 || !register_table(table)) {
+            std::cerr << "Cannot load code table '" << opt.table << "'.\n";
+            return 1;
+        }
+        if (opt.mode == Options::Compress) copt.table = &table;
+    }
+
+    if (!opt.io.empty() && !set_io_backend(opt.io.c_str()))
+        std::cerr << "io_uring is not available here; using stdio.\n";
+    set_direct_io(opt.direct);
+    set_memory_limit(opt.memory_limit);
+    set_huge_pages(opt.huge_pages);
+
+    if (opt.stats || !opt.trace.empty()) stats_enable(!opt.trace.empty());
+
+    int rc = opt.batch ? run_batch(opt, copt, status) : run_single(opt, copt, status);
+
+    if (opt.memory_limit)
+        status << "Peak memory: " << (peak_memory() + (1 << 19)) / (1 << 20) << " MiB (limit "
+               << (opt.memory_limit + (1 << 19)) / (1 << 20) << " MiB)\n";
+    status.flush();
+    if (opt.stats) stats_print(stderr);
+    if (!opt.trace.empty() && !stats_write_trace(opt.trace.c_str())) {
+        std::cerr << "Cannot write trace '" << opt.trace << "'.\n";
+        if (!rc) rc = 1;
+    }
+    return rc;
+}
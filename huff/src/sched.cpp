@@ -0,0 +1,189 @@
+#include "sched.hpp"
+#include "format.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// One line of a sysfs file, trailing newline dropped; empty if unreadable.
+static std::string read_line(const std::string& path) {
+    std::FILE* f = std::fopen(path.c_str(), "r");
+    if (!f) return {};
+    char buf[4096];
+    std::string s = std::fgets(buf, sizeof buf, f) ? buf : "";
+    std::fclose(f);
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+    return s;
+}
+
+// "2048K", "30M" -> bytes
+static std::size_t parse_size(const std::string& s) {
+    char* end = nullptr;
+    std::size_t n = std::strtoull(s.c_str(), &end, 10);
+    if (end && (*end == 'K' || *end == 'k')) n <<= 10;
+    else if (end && *end == 'M') n <<= 20;
+    else if (end && *end == 'G') n <<= 30;
+    return n;
+}
+
+// "0-3,8,10-11" -> CPU numbers
+static std::vector<int> parse_cpulist(const std::string& s) {
+    std::vector<int> cpus;
+    const char* p = s.c_str();
+    while (*p) {
+        char* end;
+        long a = std::strtol(p, &end, 10);
+        if (end == p) break;
+        long b = a;
+        if (*end == '-') b = std::strtol(end + 1, &end, 10);
+        for (long c = a; c <= b; ++c) cpus.push_back((int)c);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return cpus;
+}
+
+static std::size_t pow2_floor(std::size_t n) {
+    std::size_t p = 1;
+    while (p <= n / 2) p <<= 1;
+    return p;
+}
+
+static std::size_t g_memory_limit = 0;
+
+// Slots, then block size (not below min_block), cut until `fixed` plus every
+// slot's copies fit the limit; threads follow the slots. Never sizes 0-byte blocks.
+static void fit_memory(WorkPlan& w, std::size_t fixed, int copies, std::size_t min_block) {
+    const std::size_t limit = g_memory_limit;
+    if (limit && w.block_size) {
+        const std::size_t avail = limit > fixed ? limit - fixed : 0;
+        while (w.block_size / 2 >= min_block && avail / (copies * w.block_size) == 0) w.block_size /= 2;
+        w.slots = std::clamp<std::size_t>(avail / (copies * w.block_size), 1, w.slots);
+    }
+    w.threads = (int)std::min<std::size_t>((std::size_t)w.threads, w.slots);
+}
+
+static CpuTopology read_topology() {
+    CpuTopology t;
+    t.cpus = (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> usable;
+#if defined(__linux__)
+    // --- CPUs we may run on (taskset, cgroup cpusets) ---
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c)
+            if (CPU_ISSET(c, &set)) usable.push_back(c);
+        if (!usable.empty()) t.cpus = (int)usable.size();
+    }
+
+    // --- caches of the first usable CPU ---
+    const std::string cpu = "/sys/devices/system/cpu/cpu" + std::to_string(usable.empty() ? 0 : usable[0]) + "/cache/index";
+    int llc_level = 0;
+    for (int i = 0; i < 8; ++i) {
+        const std::string dir = cpu + std::to_string(i) + "/";
+        const std::string level = read_line(dir + "level"), type = read_line(dir + "type");
+        if (level.empty()) break;
+        if (type == "Instruction") continue;
+        const int lv = std::atoi(level.c_str());
+        const std::size_t size = parse_size(read_line(dir + "size"));
+        if (lv == 2 && size) t.l2_bytes = size;
+        if (lv >= llc_level && size) { llc_level = lv; t.llc_bytes = size; }
+    }
+
+    // --- NUMA nodes, restricted to usable CPUs ---
+    for (int n : parse_cpulist(read_line("/sys/devices/system/node/online"))) {
+        const std::string list = read_line("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+        std::vector<int> cpus;
+        for (int c : parse_cpulist(list))
+            if (std::find(usable.begin(), usable.end(), c) != usable.end()) cpus.push_back(c);
+        if (!cpus.empty()) t.nodes.push_back(std::move(cpus));
+    }
+#endif
+    if (t.nodes.empty()) t.nodes.push_back(usable);
+    return t;
+}
+
+} // namespace
+
+const CpuTopology& cpu_topology() {
+    static const CpuTopology t = read_topology();
+    return t;
+}
+
+WorkPlan plan_work(std::uint64_t input_size, int threads) {
+    const CpuTopology& topo = cpu_topology();
+    WorkPlan w;
+    const int cap = threads > 0 ? threads : topo.cpus;
+    const std::uint64_t useful = std::max<std::uint64_t>(1, (input_size + SCHED_BYTES_PER_THREAD - 1) / SCHED_BYTES_PER_THREAD);
+    w.threads = (int)std::min<std::uint64_t>((std::uint64_t)cap, useful);
+
+    // a block's input and coded output stay within half the L2
+    w.block_size = std::clamp(pow2_floor(topo.l2_bytes / 2), std::size_t(256) << 10, HUF2_BLOCK_SIZE);
+    if (w.threads > 1)
+        while (w.block_size > SCHED_MIN_BLOCK && input_size / w.block_size < 4 * (std::uint64_t)w.threads)
+            w.block_size /= 2;
+    w.slots = w.threads <= 1 ? 1 : (std::size_t)w.threads * 2;
+    if (!g_memory_limit) return w;
+
+    // per-chunk bookkeeping grows with the chunk count: keep it to a quarter
+    auto meta = [&] { return (std::size_t)((input_size + w.block_size - 1) / w.block_size) * SCHED_CHUNK_META; };
+    while (w.block_size < HUF2_BLOCK_SIZE && meta() > g_memory_limit / 4) w.block_size *= 2;
+    fit_memory(w, meta(), SCHED_CHUNK_COPIES, SCHED_MIN_BLOCK);
+    return w;
+}
+
+WorkPlan plan_stream(std::size_t block_size, int threads, int copies, std::size_t min_block) {
+    WorkPlan w;
+    w.threads = threads > 0 ? threads : cpu_topology().cpus;
+    w.block_size = block_size;
+    if (block_size == 0) { w.threads = 1; w.slots = 1; return w; }   // nothing to plan
+    w.slots = w.threads <= 1 ? 1 : (std::size_t)w.threads * 2;
+    fit_memory(w, 0, copies, std::min(min_block, block_size));
+    return w;
+}
+
+void set_memory_limit(std::size_t bytes) { g_memory_limit = bytes; }
+std::size_t memory_limit() { return g_memory_limit; }
+
+std::size_t peak_memory() {
+#if defined(_WIN32)
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return (std::size_t)ru.ru_maxrss;          // bytes
+#else
+    return (std::size_t)ru.ru_maxrss << 10;    // KiB
+#endif
+#endif
+}
+
+int worker_node(int worker) {
+    return worker % (int)cpu_topology().nodes.size();
+}
+
+int pin_worker(int worker) {
+    const CpuTopology& topo = cpu_topology();
+    const int node = worker_node(worker);
+#if defined(__linux__)
+    if (topo.nodes.size() > 1) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : topo.nodes[(std::size_t)node]) CPU_SET(c, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof set, &set);   // best effort
+    }
+#endif
+    (void)topo;
+    return node;
+}
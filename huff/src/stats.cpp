@@ -0,0 +1,155 @@
+#include "stats.hpp"
+#include "arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+bool g_stats_on = false;
+bool g_trace_on = false;
+
+namespace {
+
+constexpr const char* STAGE_NAMES[STAGE_COUNT] = {
+    "read", "histogram", "table", "encode", "stitch", "write", "decode", "crc",
+};
+
+constexpr int MAX_WORKERS = 256;   // more share the last slot
+
+struct StageTotals {
+    std::atomic<std::uint64_t> ns{0}, bytes{0}, calls{0};
+};
+
+struct Totals {
+    StageTotals stage[STAGE_COUNT];
+    std::atomic<std::uint64_t> wait_ns{0}, waits{0};
+    std::atomic<std::uint64_t> busy_ns[MAX_WORKERS] = {}, idle_ns[MAX_WORKERS] = {};
+    std::atomic<int> workers{0};
+} g_totals;
+
+std::chrono::steady_clock::time_point g_epoch;
+
+// Trace events go to a per-thread buffer; the buffers outlive their threads
+// (run_pipeline's reader exits early) and are only read after the work is done.
+struct Event {
+    Stage stage;
+    std::uint64_t t0, t1, bytes;
+};
+
+struct ThreadTrace {
+    int tid;
+    std::string name;
+    std::vector<Event> events;
+};
+
+std::mutex g_trace_mu;
+std::vector<std::unique_ptr<ThreadTrace>> g_threads;
+thread_local ThreadTrace* tls_trace = nullptr;
+
+static ThreadTrace& thread_trace() {
+    if (!tls_trace) {
+        std::lock_guard<std::mutex> lk(g_trace_mu);
+        g_threads.push_back(std::make_unique<ThreadTrace>());
+        tls_trace = g_threads.back().get();
+        tls_trace->tid = (int)g_threads.size();
+        tls_trace->name = "thread " + std::to_string(tls_trace->tid);
+    }
+    return *tls_trace;
+}
+
+static double ms(std::uint64_t ns) { return double(ns) / 1e6; }
+
+} // namespace
+
+void stats_enable(bool trace) {
+    g_epoch = std::chrono::steady_clock::now();
+    g_stats_on = true;
+    g_trace_on = trace;
+    if (trace) stats_name_thread("main");
+}
+
+std::uint64_t stats_now_ns() {
+    return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void stats_record(Stage s, std::uint64_t t0, std::uint64_t t1, std::uint64_t bytes) {
+    StageTotals& st = g_totals.stage[s];
+    st.ns.fetch_add(t1 - t0, std::memory_order_relaxed);
+    st.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    st.calls.fetch_add(1, std::memory_order_relaxed);
+    if (g_trace_on) thread_trace().events.push_back({s, t0, t1, bytes});
+}
+
+void stats_queue_wait(std::uint64_t ns) {
+    g_totals.wait_ns.fetch_add(ns, std::memory_order_relaxed);
+    g_totals.waits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void stats_worker_time(int worker, std::uint64_t busy_ns, std::uint64_t idle_ns) {
+    const int w = std::min(worker, MAX_WORKERS - 1);
+    g_totals.busy_ns[w].fetch_add(busy_ns, std::memory_order_relaxed);
+    g_totals.idle_ns[w].fetch_add(idle_ns, std::memory_order_relaxed);
+    int seen = g_totals.workers.load(std::memory_order_relaxed);
+    while (seen <= w && !g_totals.workers.compare_exchange_weak(seen, w + 1, std::memory_order_relaxed)) {}
+}
+
+void stats_name_thread(const char* name) {
+    if (g_trace_on) thread_trace().name = name;
+}
+
+void stats_print(std::FILE* f) {
+    const std::uint64_t wall = stats_now_ns();
+    std::fprintf(f, "\n%-10s %8s %12s %12s %10s\n", "stage", "calls", "MB", "thread ms", "MB/s");
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+        const StageTotals& st = g_totals.stage[s];
+        const std::uint64_t calls = st.calls.load(), ns = st.ns.load(), bytes = st.bytes.load();
+        if (!calls) continue;
+        std::fprintf(f, "%-10s %8llu %12.1f %12.1f", STAGE_NAMES[s],
+                     (unsigned long long)calls, double(bytes) / 1e6, ms(ns));
+        if (bytes && ns) std::fprintf(f, " %10.1f", double(bytes) / 1e6 / (double(ns) / 1e9));
+        std::fprintf(f, "\n");
+    }
+
+    const int workers = g_totals.workers.load();
+    std::uint64_t busy = 0, idle = 0;
+    for (int w = 0; w < workers; ++w) { busy += g_totals.busy_ns[w]; idle += g_totals.idle_ns[w]; }
+    std::fprintf(f, "\npool: %d worker%s, busy %.1f ms, idle %.1f ms\n",
+                 workers, workers == 1 ? "" : "s", ms(busy), ms(idle));
+    for (int w = 0; w < workers; ++w)
+        std::fprintf(f, "  worker %-3d busy %10.1f ms  idle %10.1f ms\n",
+                     w, ms(g_totals.busy_ns[w]), ms(g_totals.idle_ns[w]));
+    const std::uint64_t waits = g_totals.waits.load();
+    std::fprintf(f, "queue wait: %llu tasks, %.1f ms total, %.1f us avg\n",
+                 (unsigned long long)waits, ms(g_totals.wait_ns),
+                 waits ? double(g_totals.wait_ns) / 1e3 / double(waits) : 0.0);
+    const ArenaStats a = arena_stats();
+    if (a.fresh + a.reused)
+        std::fprintf(f, "buffers: %llu from the heap, %llu reused, %.1f MiB pooled\n",
+                     (unsigned long long)a.fresh, (unsigned long long)a.reused, double(a.pooled) / (1 << 20));
+    std::fprintf(f, "wall: %.1f ms\n", ms(wall));
+}
+
+bool stats_write_trace(const char* path) {
+    std::FILE* f = std::fopen(path, "w");
+    if (!f) return false;
+    std::lock_guard<std::mutex> lk(g_trace_mu);
+    std::fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char* sep = "";
+    for (const auto& t : g_threads) {
+        std::fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                        "\"args\": {\"name\": \"%s\"}}", sep, t->tid, t->name.c_str());
+        sep = ",\n";
+        for (const Event& e : t->events)
+            std::fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                            "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"bytes\": %llu}}",
+                         STAGE_NAMES[e.stage], t->tid, double(e.t0) / 1e3,
+                         double(e.t1 - e.t0) / 1e3, (unsigned long long)e.bytes);
+    }
+    std::fprintf(f, "\n]}\n");
+    return std::fclose(f) == 0;
+}
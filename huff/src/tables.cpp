@@ -0,0 +1,99 @@
+// src/tables.cpp
+#include "huff.hpp"
+#include "crc32.hpp"
+#include "decode.hpp"
+#include "format.hpp"
+#include "io.hpp"
+#include "context.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// A registered table and its decode table, built once. Entries are never
+// removed, so lookups hand out plain pointers.
+struct Registered {
+    SharedTable table;
+    DecodeTable decode;
+};
+
+std::mutex g_tables_mu;
+std::vector<std::unique_ptr<Registered>> g_tables;
+
+static std::uint32_t table_id(const std::array<std::uint8_t,256>& lengths) {
+    return crc32(lengths.data(), lengths.size());
+}
+
+// Every byte value has a code and the lengths form a prefix code (Kraft sum <= 1).
+static bool complete(const std::array<std::uint8_t,256>& lengths) {
+    std::uint64_t kraft = 0;
+    for (std::uint8_t l : lengths) {
+        if (l == 0 || l > DEC_MAX_LEN) return false;
+        kraft += std::uint64_t(1) << (DEC_MAX_LEN - l);
+    }
+    return kraft <= (std::uint64_t(1) << DEC_MAX_LEN);
+}
+
+} // namespace
+
+SharedTable train_table(const std::array<std::uint64_t,256>& freq, int max_len) {
+    // +1 for every byte: unseen ones get the longest codes instead of none
+    std::array<std::uint64_t,256> f;
+    for (int s = 0; s < 256; ++s) f[s] = freq[s] + 1;
+    SharedTable t;
+    t.lengths = code_lengths(f, max_len);
+    t.id = table_id(t.lengths);
+    return t;
+}
+
+int save_table(const char* path, const SharedTable& t) {
+    std::FILE* f = open_output(path);
+    if (!f) return 1;
+    std::uint8_t buf[HUFT_FILE_SIZE];
+    std::memcpy(buf, HUFT_MAGIC, 4);
+    for (int i = 0; i < 4; ++i) buf[4 + i] = std::uint8_t(t.id >> (8 * i));
+    std::memcpy(buf + 8, t.lengths.data(), 256);
+    bool ok = std::fwrite(buf, 1, sizeof buf, f) == sizeof buf;
+    if (close_file(f) != 0) ok = false;
+    return ok ? 0 : 3;
+}
+
+int load_table(const char* path, SharedTable& t) {
+    std::FILE* f = open_input(path);
+    if (!f) return 1;
+    std::uint8_t buf[HUFT_FILE_SIZE];
+    const bool got = std::fread(buf, 1, sizeof buf, f) == sizeof buf;
+    close_file(f);
+    if (!got || std::memcmp(buf, HUFT_MAGIC, 4) != 0) return 2;
+    t.id = load_u32_le(buf + 4);
+    std::memcpy(t.lengths.data(), buf + 8, 256);
+    return shared_table_usable(t) ? 0 : 2;
+}
+
+bool shared_table_usable(const SharedTable& t) {
+    return complete(t.lengths) && t.id == table_id(t.lengths);
+}
+
+bool register_table(const SharedTable& t) {
+    if (!shared_table_usable(t)) return false;
+    auto r = std::make_unique<Registered>();
+    r->table = t;
+    if (!build_decode_table(t.lengths, r->decode)) return false;
+
+    std::lock_guard<std::mutex> lk(g_tables_mu);
+    for (const auto& e : g_tables)
+        if (e->table.id == t.id) return true;   // already known
+    g_tables.push_back(std::move(r));
+    return true;
+}
+
+const DecodeTable* find_shared_table(std::uint32_t id) {
+    std::lock_guard<std::mutex> lk(g_tables_mu);
+    for (const auto& e : g_tables)
+        if (e->table.id == id) return &e->decode;
+    return nullptr;
+}
@@ -1,85 +1,223 @@
 #include "threads.hpp"
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
-#include <functional>
+#include "crc32.hpp"
+#include "format.hpp"
+#include "stats.hpp"
+#include "sched.hpp"
+#include <atomic>
 #include <algorithm>
+#include <cstring>
+#include <string>
 
-namespace {
-struct Job {
-    std::size_t idx;          // chunk index
-    const std::uint8_t* ptr;  // start of chunk
-    std::size_t len;          // bytes in chunk
-};
-}
-
-void encode_chunks_parallel(const std::vector<std::uint8_t>& data,
+void encode_chunks_parallel(std::span<const std::uint8_t> data,
                             const std::array<Codeword,256>& table,
                             std::size_t chunk_size,
                             int threads,
-                            std::vector<MemBitWriter>& out)
+                            std::vector<MemBitWriter>& out,
+                            const std::vector<std::uint8_t>* skip,
+                            int streams)
 {
     if (chunk_size == 0) chunk_size = 1 << 20;
-    if (threads <= 0)    threads = 4;
 
     const std::size_t total = data.size();
     const std::size_t nchunks = (total + chunk_size - 1) / chunk_size;
 
-    out.clear();
-    out.resize(nchunks); // preserve order
+    out.resize(nchunks); // preserve order; kept writers keep their buffers
+    for (MemBitWriter& w : out) w.reset();
+
+    std::vector<std::size_t> todo;
+    todo.reserve(nchunks);
+    for (std::size_t i = 0; i < nchunks; ++i)
+        if (!skip || !(*skip)[i]) todo.push_back(i);
+
+    parallel_for(todo.size(), threads, [&](std::size_t k) {
+        const std::size_t i = todo[k];
+        const std::size_t off = i * chunk_size;
+        const std::size_t len = std::min(chunk_size, total - off);
+        if (streams > 1) encode_chunk_streams(data.data() + off, len, table, streams, out[i]);
+        else             encode_chunk(data.data() + off, len, table, out[i]);
+    });
+}
+
+// --- thread pool ---
+
+namespace {
+thread_local int tls_worker = -1;   // index of the pool worker running this thread, if any
+}
+
+ThreadPool& ThreadPool::instance() {
+    // the caller of parallel_for runs tasks too, so one worker fewer than usable CPUs
+    static ThreadPool pool(cpu_topology().cpus - 1);
+    return pool;
+}
+
+ThreadPool::ThreadPool(int n) {
+    for (int i = 0; i < n; ++i) queues_.push_back(std::make_unique<Queue>());
+    threads_.reserve((std::size_t)n);
+    for (int i = 0; i < n; ++i) threads_.emplace_back([this, i] { worker_loop(i); });
+}
 
-    // Prepare jobs
-    std::queue<Job> q;
-    for (std::size_t i = 0; i < nchunks; ++i) {
-        std::size_t off = i * chunk_size;
-        std::size_t len = std::min(chunk_size, total - off);
-        q.push(Job{ i, data.data() + off, len });
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(idle_mu_);
+        stop_ = true;
     }
+    idle_cv_.notify_all();
+    for (auto& t : threads_) t.join();
+}
 
-    std::mutex mu;
-    std::condition_variable cv;
-    bool stop = false;
+void ThreadPool::submit(Task t) {
+    if (queues_.empty()) { t(); return; }
+    if (g_stats_on) {
+        t = [t = std::move(t), queued = stats_now_ns()] {
+            stats_queue_wait(stats_now_ns() - queued);
+            t();
+        };
+    }
+    std::size_t q;
+    {
+        std::lock_guard<std::mutex> lk(idle_mu_);
+        q = tls_worker >= 0 ? (std::size_t)tls_worker : rr_++ % queues_.size();
+    }
+    {
+        std::lock_guard<std::mutex> lk(queues_[q]->mu);
+        queues_[q]->tasks.push_back(std::move(t));
+    }
+    {
+        std::lock_guard<std::mutex> lk(idle_mu_);
+        ++pending_;
+    }
+    idle_cv_.notify_one();
+}
 
-    auto worker = [&]() {
-        for (;;) {
-            Job job;
-            {
-                std::unique_lock<std::mutex> lk(mu);
-                cv.wait(lk, [&]{ return stop || !q.empty(); });
-                if (stop && q.empty()) return;
-                job = q.front(); q.pop();
-            }
-            // Encode this chunk into its own MemBitWriter
-            MemBitWriter mbw;
-            const std::uint8_t* p = job.ptr;
-            for (std::size_t i = 0; i < job.len; ++i) {
-                const Codeword& cw = table[p[i]];
-                if (cw.len) mbw.write_bits(cw.code, cw.len);
+bool ThreadPool::pop(int self, Task& t) {
+    const int n = workers();
+    if (self >= 0) {
+        Queue& own = *queues_[(std::size_t)self];
+        std::lock_guard<std::mutex> lk(own.mu);
+        if (!own.tasks.empty()) {
+            t = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // steal from workers on our own NUMA node first: their tasks' data is local
+    const int node = self >= 0 && cpu_topology().nodes.size() > 1 ? worker_node(self) : -1;
+    for (int pass = node >= 0 ? 0 : 1; pass < 2; ++pass) {
+        for (int k = 1; k <= n; ++k) {
+            const int v = (self + k + n) % n;
+            if (pass == 0 && worker_node(v) != node) continue;
+            Queue& victim = *queues_[(std::size_t)v];
+            std::lock_guard<std::mutex> lk(victim.mu);
+            if (!victim.tasks.empty()) {
+                t = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
             }
-            mbw.flush();
-            out[job.idx] = std::move(mbw);
         }
-    };
-
-    std::vector<std::thread> pool;
-    pool.reserve((std::size_t)threads);
-    for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+    }
+    return false;
+}
 
-    // Kick off
+bool ThreadPool::run_one() {
+    Task t;
+    if (!pop(tls_worker, t)) return false;
     {
-        std::lock_guard<std::mutex> lk(mu);
-        cv.notify_all();
+        std::lock_guard<std::mutex> lk(idle_mu_);
+        --pending_;
     }
+    t();
+    return true;
+}
 
-    // Drain
-    {
-        std::unique_lock<std::mutex> lk(mu);
-        // When queue becomes empty, signal stop
-        while (!q.empty()) cv.wait_for(lk, std::chrono::milliseconds(5));
-        stop = true;
-        cv.notify_all();
+void ThreadPool::worker_loop(int self) {
+    tls_worker = self;
+    pin_worker(self);   // buffers this worker grows are then first-touched on its node
+    if (g_trace_on) stats_name_thread(("worker " + std::to_string(self)).c_str());
+    for (;;) {
+        const std::uint64_t t0 = g_stats_on ? stats_now_ns() : 0;
+        if (run_one()) {
+            if (g_stats_on) stats_worker_time(self, stats_now_ns() - t0, 0);
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(idle_mu_);
+        idle_cv_.wait(lk, [&] { return stop_ || pending_ > 0; });
+        if (g_stats_on) stats_worker_time(self, 0, stats_now_ns() - t0);
+        if (stop_ && pending_ == 0) return;
+    }
+}
+
+void parallel_for(std::size_t n, int threads, const std::function<void(std::size_t)>& fn)
+{
+    if (n == 0) return;
+    if (threads <= 0) threads = 4;
+    ThreadPool& pool = ThreadPool::instance();
+    const std::size_t runners = std::min({(std::size_t)threads, n, (std::size_t)pool.workers() + 1});
+
+    // every runner pulls indices from one counter, so uneven items balance out
+    std::atomic<std::size_t> next{0};
+    auto drain = [&] {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n; ) fn(i);
+    };
+    if (runners <= 1) { drain(); return; }
+
+    struct Group {
+        std::mutex mu;
+        std::condition_variable cv;
+        std::size_t left = 0;
+    } g;
+    g.left = runners - 1;
+    for (std::size_t r = 1; r < runners; ++r) {
+        pool.submit([&] {
+            drain();
+            std::lock_guard<std::mutex> lk(g.mu);   // notify under the lock: g lives on our stack
+            if (--g.left == 0) g.cv.notify_all();
+        });
     }
+    drain();
 
-    for (auto& t : pool) t.join();
+    // help with whatever is still queued, then sleep until the last runner is done
+    while (pool.run_one()) {}
+    std::unique_lock<std::mutex> lk(g.mu);
+    g.cv.wait(lk, [&] { return g.left == 0; });
+}
+
+void decode_blocks_parallel(const DecodeTable& table,
+                            std::vector<DecodeJob>& jobs,
+                            int threads)
+{
+    parallel_for(jobs.size(), threads, [&](std::size_t idx) {
+        DecodeJob& job = jobs[idx];
+        if (job.stored) {
+            {
+                StageTimer st(STAGE_DECODE, job.dst_len);
+                if (job.dst != job.src) std::memcpy(job.dst, job.src, job.dst_len);
+            }
+            StageTimer st(STAGE_CRC, job.dst_len);
+            job.crc = crc32(job.dst, job.dst_len);
+            return;
+        }
+        const DecodeTable* t = &table;
+        DecodeTable own;
+        if (job.lengths) {
+            std::array<std::uint8_t,256> lens;
+            std::copy(job.lengths, job.lengths + 256, lens.begin());
+            if (!build_decode_table(lens, own)) { job.err = 5; return; }
+            t = &own;
+        }
+        {
+            StageTimer st(STAGE_DECODE, job.dst_len);
+            if (job.multi) {
+                job.err = decode_multi(*t, job.src, job.src_len, job.dst, job.dst_len);
+            } else {
+                std::uint64_t bit = 0;
+                std::size_t got = decode_symbols(*t, job.src, job.src_len, true, bit,
+                                                 job.dst, job.dst_len, job.err);
+                if (!job.err && got != job.dst_len) job.err = 6;
+            }
+        }
+        if (!job.err) {
+            StageTimer st(STAGE_CRC, job.dst_len);
+            job.crc = crc32(job.dst, job.dst_len);
+        }
+    });
 }
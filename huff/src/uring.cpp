@@ -0,0 +1,166 @@
+#include "uring.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HUFF_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#ifdef HUFF_HAVE_URING
+
+namespace {
+
+// The kernel updates the other side of each ring concurrently.
+inline unsigned load_acquire(unsigned* p) { return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire); }
+inline void store_release(unsigned* p, unsigned v) { std::atomic_ref<unsigned>(*p).store(v, std::memory_order_release); }
+
+template <class T>
+T* at(void* base, std::uint32_t off) { return reinterpret_cast<T*>(static_cast<char*>(base) + off); }
+
+} // namespace
+
+bool IoRing::init(unsigned entries) {
+    close();
+    io_uring_params p;
+    std::memset(&p, 0, sizeof p);
+    const long fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return false;
+    fd_ = (int)fd;
+    entries_ = p.sq_entries;
+
+    sq_map_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && cq_map_len_ > sq_map_len_) sq_map_len_ = cq_map_len_;
+
+    sq_map_ = mmap(nullptr, sq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_map_ == MAP_FAILED) { sq_map_ = nullptr; close(); return false; }
+    if (single) {
+        cq_map_ = sq_map_;
+    } else {
+        cq_map_ = mmap(nullptr, cq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_map_ == MAP_FAILED) { cq_map_ = nullptr; close(); return false; }
+    }
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) { sqes_ = nullptr; close(); return false; }
+
+    sq_head_  = at<unsigned>(sq_map_, p.sq_off.head);
+    sq_tail_  = at<unsigned>(sq_map_, p.sq_off.tail);
+    sq_mask_  = at<unsigned>(sq_map_, p.sq_off.ring_mask);
+    sq_array_ = at<unsigned>(sq_map_, p.sq_off.array);
+    cq_head_  = at<unsigned>(cq_map_, p.cq_off.head);
+    cq_tail_  = at<unsigned>(cq_map_, p.cq_off.tail);
+    cq_mask_  = at<unsigned>(cq_map_, p.cq_off.ring_mask);
+    cqes_     = at<void>(cq_map_, p.cq_off.cqes);
+    queued_ = inflight_ = 0;
+    failed_ = false;
+    return true;
+}
+
+void IoRing::close() {
+    if (sqes_) munmap(sqes_, sqes_len_);
+    if (cq_map_ && cq_map_ != sq_map_) munmap(cq_map_, cq_map_len_);
+    if (sq_map_) munmap(sq_map_, sq_map_len_);
+    if (fd_ >= 0) ::close(fd_);
+    sqes_ = cq_map_ = sq_map_ = nullptr;
+    fd_ = -1;
+    entries_ = queued_ = inflight_ = 0;
+    failed_ = false;
+}
+
+void* IoRing::next_sqe() {
+    if (failed_) return nullptr;
+    const unsigned tail = *sq_tail_;
+    if (tail - load_acquire(sq_head_) >= entries_) return nullptr;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + (tail & *sq_mask_);
+    std::memset(sqe, 0, sizeof *sqe);
+    sq_array_[tail & *sq_mask_] = tail & *sq_mask_;
+    return sqe;
+}
+
+bool IoRing::read(int fd, void* p, std::size_t n, std::uint64_t off, std::uint64_t user) {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (std::uint64_t)(std::uintptr_t)p;
+    sqe->len = (std::uint32_t)n;
+    sqe->off = off;
+    sqe->user_data = user;
+    store_release(sq_tail_, *sq_tail_ + 1);
+    ++queued_;
+    return true;
+}
+
+bool IoRing::writev(int fd, const struct iovec* iov, int n, std::uint64_t off, std::uint64_t user) {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (std::uint64_t)(std::uintptr_t)iov;
+    sqe->len = (std::uint32_t)n;
+    sqe->off = off;
+    sqe->user_data = user;
+    store_release(sq_tail_, *sq_tail_ + 1);
+    ++queued_;
+    return true;
+}
+
+int IoRing::enter(unsigned submit, unsigned min_complete) {
+    for (;;) {
+        const long r = syscall(__NR_io_uring_enter, fd_, submit, min_complete,
+                               min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (r >= 0 || errno != EINTR) return (int)r;
+    }
+}
+
+bool IoRing::submit() {
+    while (queued_) {
+        const int r = enter(queued_, 0);
+        if (r <= 0) {
+            // The kernel takes entries in order: withdraw the ones it never
+            // saw, so no later enter() sends them after the caller moved on.
+            store_release(sq_tail_, *sq_tail_ - queued_);
+            queued_ = 0;
+            failed_ = true;
+            return false;
+        }
+        queued_ -= (unsigned)r;
+        inflight_ += (unsigned)r;
+    }
+    return true;
+}
+
+bool IoRing::reap(std::uint64_t& user, int& res, bool wait) {
+    if (queued_) submit();   // on failure, what was submitted before can still be reaped
+    unsigned head = *cq_head_;
+    while (head == load_acquire(cq_tail_)) {
+        if (!wait || !inflight_ || enter(0, 1) < 0) return false;
+    }
+    --inflight_;
+    const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+    user = cqe->user_data;
+    res = cqe->res;
+    store_release(cq_head_, head + 1);
+    return true;
+}
+
+#else   // no io_uring in this build: init() fails and nothing else is reached
+
+bool IoRing::init(unsigned) { return false; }
+void IoRing::close() {}
+void* IoRing::next_sqe() { return nullptr; }
+bool IoRing::read(int, void*, std::size_t, std::uint64_t, std::uint64_t) { return false; }
+bool IoRing::writev(int, const struct iovec*, int, std::uint64_t, std::uint64_t) { return false; }
+int IoRing::enter(unsigned, unsigned) { return -1; }
+bool IoRing::submit() { return false; }
+bool IoRing::reap(std::uint64_t&, int&, bool) { return false; }
+
+#endif